@@ -0,0 +1,131 @@
+/*
+ * alu.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+
+#include "alu.h"
+
+Word alu_add[2][256][256];
+Word alu_sub[2][256][256];
+Word alu_inc[256];
+Word alu_dec[256];
+Word alu_daa[8][256];
+Word alu_rot[8][2][256];
+
+static Word entry(unsigned int result, int z, int n, int h, int c) {
+	return (result & 0xFF) | (((z ? ALU_Z : 0) | (n ? ALU_N : 0)
+	                          | (h ? ALU_H : 0) | (c ? ALU_C : 0)) << 8);
+}
+
+/* a + b + cin, or a - b - cin. Bit 4 of a ^ b ^ result is the carry (or
+ * borrow) out of the low nibble, and bit 8 of the untruncated result the
+ * one out of the whole byte */
+static Word arith(unsigned int a, unsigned int b, unsigned int cin, int sub) {
+	unsigned int res = sub ? a - b - cin : a + b + cin;
+	return entry(res, (res & 0xFF) == 0, sub, (a ^ b ^ res) & 0x10,
+	             res & 0x100);
+}
+
+static Word daa(unsigned int a, int n, int h, int c) {
+	if (!n) {
+		if (h || (a & 0x0F) > 9)
+			a += 6;
+		if (c || a > 0x9F)
+			a += 0x60;
+	} else {
+		if (h)
+			a = (a - 6) & 0xFF;
+		if (c)
+			a -= 0x60;
+	}
+	/* carry is only ever set here, never cleared */
+	return entry(a, (a & 0xFF) == 0, 0, 0, c || (a & 0x100));
+}
+
+static Word rot(int op, unsigned int a, unsigned int cin) {
+	unsigned int res, c;
+
+	switch (op) {
+	case ALU_RLC:
+		res = (a << 1) | (a >> 7); c = a >> 7; break;
+	case ALU_RRC:
+		res = (a >> 1) | (a << 7); c = a & 1; break;
+	case ALU_RL:
+		res = (a << 1) | cin; c = a >> 7; break;
+	case ALU_RR:
+		res = (a >> 1) | (cin << 7); c = a & 1; break;
+	case ALU_SLA:
+		res = a << 1; c = a >> 7; break;
+	case ALU_SRA:
+		res = (a >> 1) | (a & 0x80); c = a & 1; break;
+	case ALU_SWAP:
+		res = (a >> 4) | (a << 4); c = 0; break;
+	default:
+		res = a >> 1; c = a & 1; break;
+	}
+	return entry(res, (res & 0xFF) == 0, 0, 0, c);
+}
+
+static void alu_build(void) {
+	unsigned int a, b, i;
+
+	for (i = 0; i < 2; i++) {
+		for (a = 0; a < 256; a++) {
+			for (b = 0; b < 256; b++) {
+				alu_add[i][a][b] = arith(a, b, i, 0);
+				alu_sub[i][a][b] = arith(a, b, i, 1);
+			}
+		}
+	}
+	for (a = 0; a < 256; a++) {
+		alu_inc[a] = arith(a, 1, 0, 0) & ~(ALU_KEEP_INC << 8);
+		alu_dec[a] = arith(a, 1, 0, 1) & ~(ALU_KEEP_INC << 8);
+		for (i = 0; i < 8; i++)
+			alu_daa[i][a] = daa(a, i & 4, i & 2, i & 1);
+		for (i = 0; i < 8; i++) {
+			alu_rot[i][0][a] = rot(i, a, 0);
+			alu_rot[i][1][a] = rot(i, a, 1);
+		}
+	}
+}
+
+/* fill in the tables. Only the first call does anything, whichever thread
+ * (and instance) it comes from */
+void alu_init(void) {
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, alu_build);
+}
+
+unsigned int alu_size(void) {
+	return sizeof(alu_add) + sizeof(alu_sub) + sizeof(alu_inc)
+	       + sizeof(alu_dec) + sizeof(alu_daa) + sizeof(alu_rot);
+}
@@ -0,0 +1,77 @@
+/*
+ * alu.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _ALU_H
+#define _ALU_H
+
+#include "gbem.h"
+
+/* precomputed results of the 8bit alu ops, for CORE_ALU_TABLES (see
+ * config.h). Each entry holds the result in the low byte and the flags in
+ * the high byte, laid out as in REG_F. Flags an op leaves alone are 0 in
+ * the table, and ALU_KEEP_* says which ones they are. */
+
+#define ALU_Z		0x80
+#define ALU_N		0x40
+#define ALU_H		0x20
+#define ALU_C		0x10
+
+/* the flags inc and dec don't touch */
+#define ALU_KEEP_INC	ALU_C
+/* daa leaves N as it was */
+#define ALU_KEEP_DAA	ALU_N
+
+/* the cb prefixed rotates and shifts, in opcode order: entry
+ * (opcode >> 3) & 7 for cb opcodes 0x00-0x3F */
+#define ALU_RLC		0
+#define ALU_RRC		1
+#define ALU_RL		2
+#define ALU_RR		3
+#define ALU_SLA		4
+#define ALU_SRA		5
+#define ALU_SWAP	6
+#define ALU_SRL		7
+
+/* [carry in][a][b] */
+extern Word alu_add[2][256][256];
+extern Word alu_sub[2][256][256];
+extern Word alu_inc[256];
+extern Word alu_dec[256];
+/* [N << 2 | H << 1 | C][a] */
+extern Word alu_daa[8][256];
+/* [ALU_RLC..ALU_SRL][carry in][a] */
+extern Word alu_rot[8][2][256];
+
+void alu_init(void);
+/* bytes used by all the tables, to show their cache footprint */
+unsigned int alu_size(void);
+
+#endif	//_ALU_H
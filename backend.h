@@ -0,0 +1,82 @@
+/*
+ * backend.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#include "gbem.h"
+#include "display.h"
+
+/* what the emulator is shown on: the video, audio and input side of the
+ * front end. The sdl backend opens a window and an audio device; the null
+ * one has neither and leaves each instance's frame and samples in memory
+ * (display.frame and sound_samples()). Only the first instance to call
+ * display_init and sound_init is shown and heard. */
+
+/* what poll() can ask of the main loop */
+#define BACKEND_QUIT		0x01
+#define BACKEND_DEBUG		0x02
+#define BACKEND_PAUSE		0x04
+#define BACKEND_SOUND		0x08
+#define BACKEND_RESET		0x10
+#define BACKEND_SAVE		0x20
+#define BACKEND_LOAD		0x40
+#define BACKEND_TURBO_ON	0x80
+#define BACKEND_TURBO_OFF	0x100
+
+typedef struct {
+	const char *name;
+	void (*init)(void);
+	void (*fini)(void);
+	/* a finished frame, DISPLAY_W by DISPLAY_H */
+	void (*present)(const Colour *frame);
+	/* start pulling samples with sound_fill(data, ...), from another
+	 * thread. NULL if there is nothing to play them on */
+	void (*audio_open)(int rate, void *data);
+	void (*audio_close)(void);
+	void (*audio_pause)(int pause);
+	/* keep sound_fill from running while the sample buffers change */
+	void (*audio_lock)(void);
+	void (*audio_unlock)(void);
+	/* feeds key presses to joypad_event() and returns BACKEND_ flags */
+	unsigned int (*poll)(void);
+	/* wall clock for keeping to real time, in ms. NULL to run flat out */
+	unsigned int (*ticks)(void);
+	void (*delay)(unsigned int ms);
+} Backend;
+
+extern const Backend *backend;
+#ifndef GBEM_NO_SDL
+extern const Backend backend_sdl;
+#endif
+extern const Backend backend_null;
+
+#endif	//_BACKEND_H
@@ -0,0 +1,196 @@
+/*
+ * backend_sdl.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+
+#ifndef GBEM_NO_SDL
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <SDL/SDL.h>
+
+#include "backend.h"
+#include "display.h"
+#include "joypad.h"
+#include "sound.h"
+#include "scale.h"
+
+#define SCALE		4
+
+static SDL_Surface *screen;
+static SDL_Surface *frame;		/* the lcd at its own size, scaled up to screen */
+static SDLKey key_binds[NUM_BUTTONS];
+
+static void sdl_callback(void *data, Uint8 *stream, int len) {
+	sound_fill(data, (short *)stream, len / 4);
+}
+
+static void sdl_init(void) {
+	if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+		fprintf(stderr,"sdl initialisation failed: %s\n", SDL_GetError());
+		exit(1);
+	}
+
+	screen = SDL_SetVideoMode(DISPLAY_W * SCALE, DISPLAY_H * SCALE, 32, SDL_SWSURFACE);
+	if (screen == NULL) {
+		fprintf(stderr, "video mode initialisation failed\n");
+		exit(1);
+	}
+
+	#ifdef WINDOWS
+		// redirecting the standard input/output to the console 
+		// is required with windows.
+		activate_console(); 
+	#endif // WINDOWS
+
+	printf("sdl video initialised.\n");
+	SDL_WM_SetCaption("gbem", "gbem");
+
+	frame = SDL_CreateRGBSurface(SDL_SWSURFACE, DISPLAY_W, DISPLAY_H, 32, 0, 0, 0, 0);
+	if (frame == NULL) {
+		fprintf(stderr, "could not create surface\n");
+		exit(1);
+	}
+	SDL_FillRect(screen, NULL, SDL_MapRGB(screen->format, 0xff, 0xff, 0xff));
+
+	key_binds[BUTTON_RIGHT] 	= SDLK_RIGHT;
+	key_binds[BUTTON_LEFT] 		= SDLK_LEFT;
+	key_binds[BUTTON_UP] 		= SDLK_UP;
+	key_binds[BUTTON_DOWN] 		= SDLK_DOWN;
+	key_binds[BUTTON_A] 		= SDLK_x;
+	key_binds[BUTTON_B] 		= SDLK_y;
+	key_binds[BUTTON_SELECT]	= SDLK_TAB;
+	key_binds[BUTTON_START]		= SDLK_SPACE;
+}
+
+static void sdl_fini(void) {
+	SDL_FreeSurface(frame);
+	SDL_Quit();
+}
+
+static void sdl_present(const Colour *pixels) {
+	int y;
+	for (y = 0; y < DISPLAY_H; y++)
+		memcpy((Uint8 *)frame->pixels + y * frame->pitch, &pixels[y * DISPLAY_W], DISPLAY_W * sizeof(Colour));
+	scale_nn4x(frame, screen);
+	SDL_Flip(screen);
+}
+
+static void sdl_audio_open(int rate, void *data) {
+	SDL_AudioSpec desired;
+
+	SDL_InitSubSystem(SDL_INIT_AUDIO);
+
+	desired.freq = rate;
+	desired.format = AUDIO_S16SYS;
+	desired.channels = 2;
+	desired.samples = 2048;
+	desired.callback = sdl_callback;
+	desired.userdata = data;
+	
+	if (SDL_OpenAudio(&desired, NULL) < 0) {
+		fprintf(stderr, "couldn't initialise SDL audio: %s\n", SDL_GetError());
+		exit(1);
+   	}
+	fprintf(stdout, "sdl audio initialised.\n");
+}
+
+static void sdl_audio_close(void) {
+	SDL_CloseAudio();
+}
+
+static void sdl_audio_pause(int pause) {
+	SDL_PauseAudio(pause);
+}
+
+static unsigned int sdl_poll(void) {
+	unsigned int actions = 0;
+	SDL_Event event;
+	int i;
+
+	while (SDL_PollEvent(&event)) {
+		switch (event.type) {
+			case SDL_QUIT:
+				actions |= BACKEND_QUIT;
+				break;
+			case SDL_KEYDOWN:
+				switch (event.key.keysym.sym) {
+					case SDLK_d:		actions |= BACKEND_DEBUG; break;
+					case SDLK_p:		actions |= BACKEND_PAUSE; break;
+					case SDLK_s:		actions |= BACKEND_SOUND; break;
+					case SDLK_r:		actions |= BACKEND_RESET; break;
+					case SDLK_F1:		actions |= BACKEND_SAVE; break;
+					case SDLK_F2:		actions |= BACKEND_LOAD; break;
+					case SDLK_ESCAPE:	actions |= BACKEND_QUIT; break;
+					case SDLK_LCTRL:	actions |= BACKEND_TURBO_ON; break;
+					default:			break;
+				}
+				// fall through
+			case SDL_KEYUP:
+				if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_LCTRL)
+					actions |= BACKEND_TURBO_OFF;
+				for (i = 0; i < NUM_BUTTONS; i++) {
+					if (event.key.keysym.sym == key_binds[i])
+						joypad_event(i, event.type == SDL_KEYDOWN);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	return actions;
+}
+
+static unsigned int sdl_ticks(void) {
+	return SDL_GetTicks();
+}
+
+static void sdl_delay(unsigned int ms) {
+	SDL_Delay(ms);
+}
+
+const Backend backend_sdl = {
+	"sdl",
+	sdl_init,
+	sdl_fini,
+	sdl_present,
+	sdl_audio_open,
+	sdl_audio_close,
+	sdl_audio_pause,
+	SDL_LockAudio,
+	SDL_UnlockAudio,
+	sdl_poll,
+	sdl_ticks,
+	sdl_delay
+};
+
+#endif /* GBEM_NO_SDL */
@@ -0,0 +1,435 @@
+/*
+ * batch.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "batch.h"
+#include "libgbem.h"
+#include "movie.h"
+
+#define BATCH_LINE		1024
+#define BATCH_THREADS	256
+
+/* a rom file, loaded by the first job that needs it and shared by the
+ * rest. Freed when the last of them is done */
+typedef struct {
+	char *fn;
+	unsigned char *data;
+	unsigned int size;
+	int users;				/* jobs yet to finish with it */
+	int is_bad;				/* couldn't be read */
+	pthread_mutex_t lock;
+} BatchRom;
+
+/* a run of frames with the same buttons held */
+typedef struct {
+	unsigned int frames;
+	unsigned int buttons;
+} BatchInput;
+
+typedef struct {
+	unsigned int rom;		/* in roms */
+	unsigned int frames;
+	char *input;
+	char *output;
+	/* results */
+	int status;				/* 0 when it ran */
+	uint64_t hash;
+	unsigned int sram_size;
+	double seconds;
+} BatchJob;
+
+/* the jobs from next up to end are this worker's. Others take from the
+ * end when they run out */
+typedef struct {
+	pthread_t thread;
+	unsigned int next, end;
+	pthread_mutex_t lock;
+} BatchWorker;
+
+static BatchRom *roms;
+static unsigned int rom_count;
+static BatchJob *jobs;
+static unsigned int job_count;
+static BatchWorker *workers;
+static unsigned int worker_count;
+
+static double thread_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int find_rom(const char *fn) {
+	unsigned int i;
+
+	for (i = 0; i < rom_count; i++) {
+		if (strcmp(roms[i].fn, fn) == 0)
+			return i;
+	}
+	roms = realloc(roms, (rom_count + 1) * sizeof(BatchRom));
+	memset(&roms[rom_count], 0, sizeof(BatchRom));
+	roms[rom_count].fn = strdup(fn);
+	return rom_count++;
+}
+
+static int read_manifest(const char *fn) {
+	FILE *fp;
+	char line[BATCH_LINE];
+	char rom[BATCH_LINE], input[BATCH_LINE], output[BATCH_LINE];
+	unsigned int frames;
+	unsigned int n = 0, i;
+
+	fp = fopen(fn, "r");
+	if (fp == NULL) {
+		perror(fn);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		++n;
+		if (line[0] == '#' || strspn(line, " \t\r\n") == strlen(line))
+			continue;
+		if (sscanf(line, "%s %u %s %s", rom, &frames, input, output) != 4) {
+			fprintf(stderr, "%s:%u: expected rom frames input output\n", fn, n);
+			fclose(fp);
+			return -1;
+		}
+		jobs = realloc(jobs, (job_count + 1) * sizeof(BatchJob));
+		memset(&jobs[job_count], 0, sizeof(BatchJob));
+		jobs[job_count].rom = find_rom(rom);
+		++roms[jobs[job_count].rom].users;
+		jobs[job_count].frames = frames;
+		jobs[job_count].input = strcmp(input, "-") != 0 ? strdup(input) : NULL;
+		jobs[job_count].output = strcmp(output, "-") != 0 ? strdup(output) : NULL;
+		jobs[job_count].status = -1;
+		++job_count;
+	}
+	fclose(fp);
+	/* not before, as roms moves while it grows */
+	for (i = 0; i < rom_count; i++)
+		pthread_mutex_init(&roms[i].lock, NULL);
+	return 0;
+}
+
+/* the rom's data, reading it in if this is the first job to want it */
+static int rom_get(BatchRom *r) {
+	FILE *fp;
+	long len;
+	int ret = 0;
+
+	pthread_mutex_lock(&r->lock);
+	if (r->data == NULL && !r->is_bad) {
+		fp = fopen(r->fn, "rb");
+		if (fp == NULL) {
+			perror(r->fn);
+			r->is_bad = 1;
+		} else {
+			fseek(fp, 0, SEEK_END);
+			len = ftell(fp);
+			fseek(fp, 0, SEEK_SET);
+			r->data = malloc(len > 0 ? len : 1);
+			r->size = len;
+			if (len <= 0 || fread(r->data, 1, len, fp) != (size_t)len) {
+				fprintf(stderr, "%s: read error\n", r->fn);
+				free(r->data);
+				r->data = NULL;
+				r->is_bad = 1;
+			}
+			fclose(fp);
+		}
+	}
+	if (r->is_bad)
+		ret = -1;
+	pthread_mutex_unlock(&r->lock);
+	return ret;
+}
+
+static void rom_put(BatchRom *r) {
+	pthread_mutex_lock(&r->lock);
+	if (--r->users == 0) {
+		free(r->data);
+		r->data = NULL;
+	}
+	pthread_mutex_unlock(&r->lock);
+}
+
+/* non zero if the file is an input movie rather than runs of buttons */
+static int is_movie(const char *fn) {
+	FILE *fp;
+	char magic[sizeof(MOVIE_MAGIC) - 1];
+	int ret;
+
+	fp = fopen(fn, "rb");
+	if (fp == NULL)
+		return 0;
+	ret = fread(magic, 1, sizeof(magic), fp) == sizeof(magic) &&
+	      memcmp(magic, MOVIE_MAGIC, sizeof(magic)) == 0;
+	fclose(fp);
+	return ret;
+}
+
+/* the job's input file, or NULL with count 0 for none */
+static BatchInput *read_input(const char *fn, unsigned int *count) {
+	FILE *fp;
+	BatchInput *input = NULL;
+	unsigned int frames;
+	int buttons;		/* %i, so masks can be given in hex */
+
+	*count = 0;
+	if (fn == NULL)
+		return NULL;
+	fp = fopen(fn, "r");
+	if (fp == NULL) {
+		perror(fn);
+		return NULL;
+	}
+	while (fscanf(fp, "%u %i", &frames, &buttons) == 2) {
+		input = realloc(input, (*count + 1) * sizeof(BatchInput));
+		input[*count].frames = frames;
+		input[*count].buttons = buttons & 0xFF;
+		++*count;
+	}
+	fclose(fp);
+	return input;
+}
+
+static void write_ppm(const char *fn, const uint32_t *frame) {
+	FILE *fp;
+	unsigned int i;
+
+	fp = fopen(fn, "wb");
+	if (fp == NULL) {
+		perror(fn);
+		return;
+	}
+	fprintf(fp, "P6\n%d %d\n255\n", GBEM_FRAME_W, GBEM_FRAME_H);
+	for (i = 0; i < GBEM_FRAME_W * GBEM_FRAME_H; i++) {
+		fputc((frame[i] >> 16) & 0xFF, fp);
+		fputc((frame[i] >> 8) & 0xFF, fp);
+		fputc(frame[i] & 0xFF, fp);
+	}
+	fclose(fp);
+}
+
+static void write_outputs(BatchJob *job, struct GbInstance *g) {
+	const uint8_t *sram;
+	char *fn;
+	FILE *fp;
+
+	fn = malloc(strlen(job->output) + 5);
+	sprintf(fn, "%s.ppm", job->output);
+	write_ppm(fn, gbem_frame(g));
+	sram = gbem_sram(g, &job->sram_size);
+	if (sram != NULL) {
+		sprintf(fn, "%s.sav", job->output);
+		fp = fopen(fn, "wb");
+		if (fp == NULL) {
+			perror(fn);
+		} else {
+			fwrite(sram, 1, job->sram_size, fp);
+			fclose(fp);
+		}
+	}
+	free(fn);
+}
+
+/* play the job on g, with its rom loaded. Returns 0 if it ran */
+static int play_job(BatchJob *job, struct GbInstance *g) {
+	BatchInput *input = NULL;
+	unsigned int inputs = 0, in = 0, left = 0, f;
+
+	if (job->input != NULL && is_movie(job->input)) {
+		if (gbem_movie_play_file(g, job->input) != 0)
+			return -1;
+	} else {
+		input = read_input(job->input, &inputs);
+		if (inputs > 0)
+			left = input[0].frames;
+	}
+	for (f = 0; f < job->frames; f++) {
+		/* the last buttons are held to the end */
+		while (left == 0 && in + 1 < inputs)
+			left = input[++in].frames;
+		gbem_set_buttons(g, inputs > 0 ? input[in].buttons : 0);
+		if (left > 0)
+			--left;
+		gbem_run_frame(g);
+	}
+	free(input);
+
+	job->hash = gbem_frame_hash(g);
+	if (job->output != NULL)
+		write_outputs(job, g);
+	else
+		gbem_sram(g, &job->sram_size);
+	return 0;
+}
+
+static void run_job(BatchJob *job) {
+	BatchRom *rom = &roms[job->rom];
+	struct GbInstance *g;
+	double start;
+
+	if (rom_get(rom) != 0) {
+		rom_put(rom);
+		return;
+	}
+	start = thread_time();
+	g = gbem_new();
+	if (gbem_load_rom_shared(g, rom->data, rom->size) == 0)
+		job->status = play_job(job, g);
+	gbem_free(g);
+	job->seconds = thread_time() - start;
+	rom_put(rom);
+}
+
+/* the next job for worker w: its own, or else the back half of what the
+ * next worker with any left has. Returns -1 when all are taken. Only one
+ * lock is held at a time */
+static int take_job(BatchWorker *w) {
+	unsigned int i, left, take = 0;
+	BatchWorker *v;
+	int job = -1;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->next < w->end)
+		job = w->next++;
+	pthread_mutex_unlock(&w->lock);
+	if (job >= 0)
+		return job;
+
+	for (i = 0; i < worker_count; i++) {
+		v = &workers[(w - workers + 1 + i) % worker_count];
+		if (v == w)
+			continue;
+		pthread_mutex_lock(&v->lock);
+		left = v->end - v->next;
+		if (left > 0) {
+			take = (left + 1) / 2;
+			v->end -= take;
+			job = v->end;
+		}
+		pthread_mutex_unlock(&v->lock);
+		if (job >= 0) {
+			/* run the first now, and keep the rest */
+			pthread_mutex_lock(&w->lock);
+			w->next = job + 1;
+			w->end = job + take;
+			pthread_mutex_unlock(&w->lock);
+			return job;
+		}
+	}
+	return -1;
+}
+
+static void *batch_worker(void *data) {
+	BatchWorker *w = data;
+	int job;
+
+	while ((job = take_job(w)) >= 0)
+		run_job(&jobs[job]);
+	return NULL;
+}
+
+int batch_main(int argc, char *argv[]) {
+	const char *report = "-";
+	FILE *out = stdout;
+	unsigned int i;
+	double start, elapsed;
+	struct timespec ts;
+	int ret = 0;
+
+	if (argc < 3) {
+		printf("%s -batch manifest [report.csv [threads]]\n", argv[0]);
+		return 1;
+	}
+	if (argc >= 4)
+		report = argv[3];
+	if (argc >= 5)
+		worker_count = atoi(argv[4]);
+	else
+		worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (worker_count < 1)
+		worker_count = 1;
+	if (worker_count > BATCH_THREADS)
+		worker_count = BATCH_THREADS;
+
+	if (read_manifest(argv[2]) != 0)
+		return 1;
+	if (strcmp(report, "-") != 0) {
+		out = fopen(report, "w");
+		if (out == NULL) {
+			perror(report);
+			return 1;
+		}
+	}
+	if (worker_count > job_count && job_count > 0)
+		worker_count = job_count;
+
+	/* deal the jobs out in runs, so jobs on the same rom tend to stay on
+	 * one worker while they can */
+	workers = calloc(worker_count, sizeof(BatchWorker));
+	for (i = 0; i < worker_count; i++) {
+		workers[i].next = (unsigned long)job_count * i / worker_count;
+		workers[i].end = (unsigned long)job_count * (i + 1) / worker_count;
+		pthread_mutex_init(&workers[i].lock, NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	start = ts.tv_sec + ts.tv_nsec / 1e9;
+	for (i = 0; i < worker_count; i++)
+		pthread_create(&workers[i].thread, NULL, batch_worker, &workers[i]);
+	for (i = 0; i < worker_count; i++)
+		pthread_join(workers[i].thread, NULL);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	elapsed = ts.tv_sec + ts.tv_nsec / 1e9 - start;
+
+	fprintf(out, "rom,frames,input,status,frame_hash,sram_bytes,seconds\n");
+	for (i = 0; i < job_count; i++) {
+		BatchJob *job = &jobs[i];
+		fprintf(out, "%s,%u,%s,%s,%016llx,%u,%.3f\n", roms[job->rom].fn,
+		        job->frames, job->input != NULL ? job->input : "-",
+		        job->status == 0 ? "ok" : "failed",
+		        (unsigned long long)job->hash, job->sram_size, job->seconds);
+		if (job->status != 0)
+			ret = 1;
+	}
+	if (out != stdout)
+		fclose(out);
+	fprintf(stderr, "%u jobs on %u threads in %.3fs\n", job_count,
+	        worker_count, elapsed);
+	return ret;
+}
@@ -0,0 +1,51 @@
+/*
+ * batch.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+/* gbem -batch manifest [report.csv [threads]]: runs a list of jobs, each a
+ * rom played headless for a number of frames, on a pool of threads, one
+ * per cpu unless told otherwise. Each line of the manifest is
+ *
+ *	rom frames input output
+ *
+ * where input is an input movie (see movie.h), or a file of "frames
+ * buttons" lines, each holding the buttons (a GBEM_* mask, see libgbem.h)
+ * for that many frames, or - for none; and output is a prefix for the files written at the end of the
+ * job: the frame as <output>.ppm and the cart ram as <output>.sav, or -
+ * for neither. Blank lines and lines starting with # are skipped.
+ *
+ * The report has a line of csv per job, in the order of the manifest,
+ * with the hash of the last frame and how long the job took. */
+int batch_main(int argc, char *argv[]);
+
+#endif /* _BATCH_H */
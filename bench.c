@@ -0,0 +1,870 @@
+/*
+ * bench.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "bench.h"
+#include "memory.h"
+#include "core.h"
+#include "sound.h"
+#include "alu.h"
+#include "cart.h"
+#include "display.h"
+#include "split.h"
+#include "instance.h"
+#include "libgbem.h"
+
+#define BENCH_SLICE		70224		/* one frame worth of cycles */
+#define BENCH_RAM		0xC000
+#define BENCH_ROM		0x0150
+#define BENCH_FRAMES	3600		/* a minute of play, for the rom bench */
+#define BENCH_HOLD		20			/* frames each step of bench_input lasts */
+#define BENCH_DEFAULT	"test/roms/free/linkcable.gb"
+#define BENCH_TILES		384			/* both tile data tables, one vram bank */
+#define BENCH_HALT_FRAMES	60			/* frames the halt check looks at */
+
+typedef struct {
+	const char *name;
+	const char *description;
+	int (*run)(double seconds);		/* returns 0 on success */
+} Bench;
+
+static int bench_core(double seconds);
+static int bench_alu(double seconds);
+static int bench_alumix(double seconds);
+static int bench_alucheck(double seconds);
+static int bench_mem(double seconds);
+static int bench_tiles(double seconds);
+static int bench_resolve(double seconds);
+static int bench_haltcheck(double seconds);
+
+static const Bench benches[] = {
+	{"core", "interpreter dispatch on a mixed instruction loop", bench_core},
+	{"alu", "8bit arithmetic with few flag reads", bench_alu},
+	{"alumix", "arithmetic, daa and shifts on widely varying values",
+	 bench_alumix},
+	{"alucheck", "check the cpu core against the alu tables, for every input",
+	 bench_alucheck},
+	{"mem", "memory copies and stack traffic", bench_mem},
+	{"tiles", "decoding every flip of 384 tiles, as after a vram reload",
+	 bench_tiles},
+	{"resolve", "turning scan line codes into pixels, for whole frames",
+	 bench_resolve},
+	{"haltcheck", "check a cpu halted between timer interrupts still sees "
+	 "every frame drawn", bench_haltcheck},
+	{NULL, NULL, NULL}
+};
+
+/* a small loop mixing loads, alu ops, cb prefixed ops, stack ops, branches
+ * and a call/ret pair. Addresses are offsets from where it is loaded; the
+ * call target is patched in when it is loaded */
+static const Byte core_program[] = {
+	0x21, 0x00, 0xC1,	/* 00: LD HL, C100 */
+	0x06, 0x00,			/* 03: LD B, 0 */
+	0x0E, 0x01,			/* 05: LD C, 1 */
+	0x26, 0xC1,			/* 07: LD H, C1 (loop) */
+	0x2A,				/* 09: LD A, (HL+) */
+	0x80,				/* 0A: ADD A, B */
+	0xA9,				/* 0B: XOR C */
+	0x57,				/* 0C: LD D, A */
+	0xCB, 0x11,			/* 0D: RL C */
+	0x04,				/* 0F: INC B */
+	0x1D,				/* 10: DEC E */
+	0xA2,				/* 11: AND D */
+	0x77,				/* 12: LD (HL), A */
+	0xC5,				/* 13: PUSH BC */
+	0xD1,				/* 14: POP DE */
+	0xFE, 0x10,			/* 15: CP 10 */
+	0x20, 0x00,			/* 17: JR NZ, +0 */
+	0xCD, 0x00, 0x00,	/* 19: CALL 1E */
+	0x18, 0xE9,			/* 1C: JR 07 */
+	0x8B,				/* 1E: ADC A, E */
+	0x92,				/* 1F: SUB D */
+	0xC9				/* 20: RET */
+};
+#define CORE_LOOP		0x07
+#define CORE_CALL		0x1A
+#define CORE_SUB		0x1E
+
+/* add/subtract heavy loop, where only adc/sbc look at the flags */
+static const Byte alu_program[] = {
+	0x21, 0x00, 0xC1,	/* 00: LD HL, C100 */
+	0x06, 0x01,			/* 03: LD B, 1 */
+	0x0E, 0x03,			/* 05: LD C, 3 */
+	0x80,				/* 07: ADD A, B (loop) */
+	0x89,				/* 08: ADC A, C */
+	0x90,				/* 09: SUB B */
+	0x99,				/* 0A: SBC A, C */
+	0x04,				/* 0B: INC B */
+	0x0D,				/* 0C: DEC C */
+	0x86,				/* 0D: ADD A, (HL) */
+	0xA9,				/* 0E: XOR C */
+	0x81,				/* 0F: ADD A, C */
+	0x3C,				/* 10: INC A */
+	0x91,				/* 11: SUB C */
+	0x88,				/* 12: ADC A, B */
+	0x98,				/* 13: SBC A, B */
+	0x05,				/* 14: DEC B */
+	0x0C,				/* 15: INC C */
+	0xB9,				/* 16: CP C */
+	0x83,				/* 17: ADD A, E */
+	0x9A,				/* 18: SBC A, D */
+	0x5F,				/* 19: LD E, A */
+	0x1C,				/* 1A: INC E */
+	0x15,				/* 1B: DEC D */
+	0x18, 0xE9			/* 1C: JR 07 */
+};
+#define ALU_LOOP		0x07
+
+/* a mix of the ops CORE_ALU_TABLES covers, with operands that wander over
+ * the whole byte range, so table lookups are spread over the tables */
+static const Byte alumix_program[] = {
+	0x06, 0x5A,			/* 00: LD B, 5A */
+	0x0E, 0xA7,			/* 02: LD C, A7 */
+	0x80,				/* 04: ADD A, B (loop) */
+	0x27,				/* 05: DAA */
+	0xCB, 0x11,			/* 06: RL C */
+	0x89,				/* 08: ADC A, C */
+	0xCB, 0x08,			/* 09: RRC B */
+	0x98,				/* 0B: SBC A, B */
+	0xCB, 0x37,			/* 0C: SWAP A */
+	0x91,				/* 0E: SUB C */
+	0x27,				/* 0F: DAA */
+	0xCB, 0x3F,			/* 10: SRL A */
+	0x88,				/* 12: ADC A, B */
+	0xCB, 0x2F,			/* 13: SRA A */
+	0x3C,				/* 15: INC A */
+	0xCB, 0x27,			/* 16: SLA A */
+	0x99,				/* 18: SBC A, C */
+	0x0D,				/* 19: DEC C */
+	0xCB, 0x00,			/* 1A: RLC B */
+	0x18, 0xE6			/* 1C: JR 04 */
+};
+#define ALUMIX_LOOP		0x04
+
+/* a 16 byte copy between work ram buffers, then some pushes, pops and a
+ * store to high ram */
+static const Byte mem_program[] = {
+	0x21, 0x00, 0xC1,	/* 00: LD HL, C100 */
+	0x11, 0x00, 0xC2,	/* 03: LD DE, C200 */
+	0x0E, 0x10,			/* 06: LD C, 10 (loop) */
+	0x2A,				/* 08: LD A, (HL+) */
+	0x12,				/* 09: LD (DE), A */
+	0x13,				/* 0A: INC DE */
+	0x0D,				/* 0B: DEC C */
+	0x20, 0xFA,			/* 0C: JR NZ, 08 */
+	0xC5,				/* 0E: PUSH BC */
+	0xD5,				/* 0F: PUSH DE */
+	0xE5,				/* 10: PUSH HL */
+	0xE1,				/* 11: POP HL */
+	0xD1,				/* 12: POP DE */
+	0xC1,				/* 13: POP BC */
+	0xE0, 0x80,			/* 14: LDH (80), A */
+	0x2E, 0x00,			/* 16: LD L, 00 */
+	0x1E, 0x00,			/* 18: LD E, 00 */
+	0x18, 0xEA			/* 1A: JR 06 */
+};
+#define MEM_LOOP		0x06
+
+/* the ops checked by bench_alucheck, each run as A = A op D. The rotates
+ * and shifts are in the order of alu_rot */
+static const struct {
+	const char *name;
+	Byte opcode[2];
+	unsigned int length;
+} alu_ops[] = {
+	{"add", {0x82}, 1}, {"adc", {0x8A}, 1}, {"sub", {0x92}, 1},
+	{"sbc", {0x9A}, 1}, {"inc", {0x3C}, 1}, {"dec", {0x3D}, 1},
+	{"daa", {0x27}, 1}, {"rlc", {0xCB, 0x07}, 2}, {"rrc", {0xCB, 0x0F}, 2},
+	{"rl", {0xCB, 0x17}, 2}, {"rr", {0xCB, 0x1F}, 2},
+	{"sla", {0xCB, 0x27}, 2}, {"sra", {0xCB, 0x2F}, 2},
+	{"swap", {0xCB, 0x37}, 2}, {"srl", {0xCB, 0x3F}, 2}
+};
+#define ALU_OPS			(sizeof(alu_ops) / sizeof(alu_ops[0]))
+#define ALU_TWO_OPERAND	4	/* the first four also depend on D */
+
+/* the buttons the rom bench holds, BENCH_HOLD frames at a time, over and
+ * over: letting go between presses, as games wait for a new press. Enough
+ * to get most games past their title screens and moving about */
+static const unsigned int bench_input[] = {
+	0, 0, 0, GBEM_START, 0, GBEM_START, 0, GBEM_A, 0, GBEM_A,
+	GBEM_RIGHT, GBEM_RIGHT | GBEM_A, GBEM_DOWN, GBEM_LEFT, GBEM_UP | GBEM_B,
+	0, GBEM_A, 0, GBEM_SELECT, 0
+};
+#define BENCH_INPUTS	(sizeof(bench_input) / sizeof(bench_input[0]))
+
+static Byte *bench_rom;
+static const char *golden_dir;		/* of frame hash logs, for -b rom */
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* set up a bare machine (no cart, no display) with a program loaded at
+ * base, which can be in rom or work ram */
+static void bench_machine(const Byte *program, unsigned size, Word base) {
+	unsigned i;
+	memory_reset();
+	core_reset();
+	bench_rom = calloc(SIZE_ROM_BANK_0 + SIZE_ROM_BANK_SW, 1);
+	set_vector_block(MEM_ROM_BANK_0, bench_rom, SIZE_ROM_BANK_0 + SIZE_ROM_BANK_SW);
+	for (i = 0; i < size; i++) {
+		if (base < MEM_VIDEO)
+			bench_rom[base + i] = program[i];
+		else
+			writeb(base + i, program[i]);
+	}
+	write_io(HWREG_IE, 0);
+	write_io(HWREG_IF, 0);
+	core.ime = 0;
+	update_ints();
+	core.reg_sp = 0xDFF0;
+	core.reg_pc = base;
+}
+
+static void bench_machine_fini(void) {
+	free(bench_rom);
+}
+
+/* print which of the optional cpu core features were built in */
+static void bench_config(void) {
+	printf("engine: %s%s%s\n",
+#ifdef CORE_THREADED
+	       "threaded",
+#else
+	       "switch",
+#endif
+#ifdef CORE_BLOCK_CACHE
+	       ", block cache",
+#else
+	       "",
+#endif
+#ifdef CORE_LAZY_FLAGS
+	       ", lazy flags"
+#else
+	       ""
+#endif
+	       );
+#ifdef CORE_ALU_TABLES
+	printf("alu: tables, %uK\n", alu_size() / 1024);
+#else
+	printf("alu: helpers\n");
+#endif
+}
+
+/* load a program at base and run it, measuring the loop starting at offset
+ * loop. Prints and returns instructions per second */
+static double bench_loop(const char *where, const Byte *program,
+                         unsigned size, Word base, Word loop, double seconds) {
+	unsigned long long cycles = 0;
+	unsigned iter_cycles = 0, iter_instrs = 0;
+	double start, elapsed, ips;
+
+	bench_machine(program, size, base);
+
+	/* single step up to the loop, then once round it to measure it */
+	while (core.reg_pc != base + loop)
+		execute_cycles(1);
+	do {
+		iter_cycles += execute_cycles(1);
+		++iter_instrs;
+	} while (core.reg_pc != base + loop);
+
+	start = now();
+	do {
+		cycles += execute_cycles(BENCH_SLICE);
+		sound_cycles = 0;
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	ips = (double)cycles / iter_cycles * iter_instrs / elapsed;
+	printf("%s: %u instructions, %u cycles per loop; "
+	       "%.0f instructions/s, %.1f x realtime\n", where, iter_instrs,
+	       iter_cycles, ips, cycles / elapsed / (4 * 1048576));
+	bench_machine_fini();
+	return ips;
+}
+
+static double bench_core_at(const char *where, Word base, double seconds) {
+	Byte program[sizeof(core_program)];
+
+	memcpy(program, core_program, sizeof(program));
+	program[CORE_CALL] = (base + CORE_SUB) & 0xFF;
+	program[CORE_CALL + 1] = (base + CORE_SUB) >> 8;
+	return bench_loop(where, program, sizeof(program), base, CORE_LOOP,
+	                  seconds);
+}
+
+static int bench_core(double seconds) {
+	bench_config();
+	bench_core_at("ram", BENCH_RAM, seconds);
+	bench_core_at("rom", BENCH_ROM, seconds);
+	return 0;
+}
+
+static int bench_alu(double seconds) {
+	bench_config();
+	bench_loop("rom", alu_program, sizeof(alu_program), BENCH_ROM, ALU_LOOP,
+	           seconds);
+	return 0;
+}
+
+static int bench_alumix(double seconds) {
+	bench_config();
+	bench_loop("rom", alumix_program, sizeof(alumix_program), BENCH_ROM,
+	           ALUMIX_LOOP, seconds);
+	return 0;
+}
+
+static int bench_mem(double seconds) {
+	bench_config();
+	bench_loop("rom", mem_program, sizeof(mem_program), BENCH_ROM, MEM_LOOP,
+	           seconds);
+	return 0;
+}
+
+/* what the tables say op does to a, d and flags f, as result | F << 8 */
+static Word alu_expect(unsigned int op, Byte a, Byte d, Byte f) {
+	unsigned int c = (f & ALU_C) != 0;
+
+	switch (op) {
+	case 0:
+		return alu_add[0][a][d];
+	case 1:
+		return alu_add[c][a][d];
+	case 2:
+		return alu_sub[0][a][d];
+	case 3:
+		return alu_sub[c][a][d];
+	case 4:
+		return alu_inc[a] | (f & ALU_KEEP_INC) << 8;
+	case 5:
+		return alu_dec[a] | (f & ALU_KEEP_INC) << 8;
+	case 6:
+		return alu_daa[(f >> 4) & 7][a] | (f & ALU_KEEP_DAA) << 8;
+	default:
+		return alu_rot[op - 7][c][a];
+	}
+}
+
+/* run every op in alu_ops through the cpu core for every value of A, D
+ * (where used) and the flags, and compare with the tables. Without
+ * CORE_ALU_TABLES this checks the tables against the alu helpers in
+ * core.c; with it, it checks how core.c unpacks them */
+static int bench_alucheck(double seconds) {
+	unsigned long cases = 0, bad = 0;
+	unsigned int op, a, d, f, i;
+	Byte program[8];
+	Word end, got, want;
+
+	(void)seconds;
+	bench_config();
+	alu_init();
+	for (op = 0; op < ALU_OPS; op++) {
+		/* PUSH BC; POP AF; op A, D; PUSH AF; POP BC */
+		i = 0;
+		program[i++] = 0xC5;
+		program[i++] = 0xF1;
+		program[i++] = alu_ops[op].opcode[0];
+		if (alu_ops[op].length == 2)
+			program[i++] = alu_ops[op].opcode[1];
+		program[i++] = 0xF5;
+		program[i++] = 0xC1;
+		bench_machine(program, i, BENCH_RAM);
+		end = BENCH_RAM + i;
+
+		for (a = 0; a < 256; a++)
+		for (d = 0; d < (op < ALU_TWO_OPERAND ? 256 : 1); d++)
+		for (f = 0; f < 256; f += 0x10) {
+			core.reg_bc.b.h = a;
+			core.reg_bc.b.l = f;
+			core.reg_de.b.h = d;
+			core.reg_pc = BENCH_RAM;
+			while (core.reg_pc != end)
+				execute_cycles(1);
+			sound_cycles = 0;
+
+			got = core.reg_bc.b.h | core.reg_bc.b.l << 8;
+			want = alu_expect(op, a, d, f);
+			if (got != want && bad++ < 16)
+				printf("%s: a %02x d %02x f %02x: core %02x f %02x, "
+				       "table %02x f %02x\n", alu_ops[op].name, a, d, f,
+				       got & 0xFF, got >> 8, want & 0xFF, want >> 8);
+			++cases;
+		}
+		bench_machine_fini();
+	}
+	printf("%lu cases, %lu mismatches\n", cases, bad);
+	return bad != 0;
+}
+
+/* turns the lcd on with every background tile black and only the timer
+ * interrupt enabled, then halts for good. The cpu sleeps from one timer
+ * interrupt to the next, and mustn't sleep through vblank while it does */
+static const Byte halt_program[] = {
+	0xAF,				/* 00: XOR A */
+	0xE0, 0x40,			/* 01: LDH (LCDC), A */
+	0x21, 0x00, 0x80,	/* 03: LD HL, 8000 */
+	0x06, 0x10,			/* 06: LD B, 16 */
+	0x3E, 0xFF,			/* 08: LD A, FF */
+	0x22,				/* 0A: LD (HL+), A (tile 0) */
+	0x05,				/* 0B: DEC B */
+	0x20, 0xFC,			/* 0C: JR NZ, 0A */
+	0x3E, 0xE4,			/* 0E: LD A, E4 */
+	0xE0, 0x47,			/* 10: LDH (BGP), A */
+	0x3E, 0x91,			/* 12: LD A, 91 */
+	0xE0, 0x40,			/* 14: LDH (LCDC), A */
+	0x3E, 0x04,			/* 16: LD A, 04 */
+	0xE0, 0xFF,			/* 18: LDH (IE), A */
+	0xE0, 0x07,			/* 1A: LDH (TAC), A */
+	0xFB,				/* 1C: EI */
+	0x76,				/* 1D: HALT */
+	0x18, 0xFD			/* 1E: JR 1D */
+};
+
+/* run halt_program as a rom and check each frame ends at vblank, and
+ * comes out black rather than blank */
+static int bench_haltcheck(double seconds) {
+	unsigned int size = SIZE_ROM_BANK_0 + SIZE_ROM_BANK_SW;
+	Byte *rom = calloc(size, 1);
+	GbInstance *was = gb;		/* bench_main() tidies up after this one */
+	GbInstance *g = gbem_new();
+	const uint32_t *frame;
+	unsigned int f, i, ly, bad = 0;
+
+	(void)seconds;
+	memcpy(rom + CART_SG_DATA, sg_data, CART_ROM_TITLE - CART_SG_DATA);
+	rom[CART_ROM_ENTRY] = 0xC3;		/* JP 0150 */
+	rom[CART_ROM_ENTRY + 1] = BENCH_ROM & 0xFF;
+	rom[CART_ROM_ENTRY + 2] = BENCH_ROM >> 8;
+	rom[0x50] = 0xD9;				/* timer interrupt: RETI */
+	memcpy(rom + BENCH_ROM, halt_program, sizeof(halt_program));
+	if (gbem_load_rom(g, rom, size) != 0) {
+		gbem_free(g);
+		free(rom);
+		gb_select(was);
+		return 1;
+	}
+	/* the first frame starts with the lcd off */
+	gbem_run_frame(g);
+	for (f = 0; f < BENCH_HALT_FRAMES; f++) {
+		gbem_run_frame(g);
+		ly = gbem_peek(g, HWREG_LY);
+		frame = gbem_frame(g);
+		for (i = 0; i < DISPLAY_W * DISPLAY_H; i++)
+			if (frame[i] != display.mono_colours[3])
+				break;
+		if (ly != DISPLAY_H || i < DISPLAY_W * DISPLAY_H) {
+			if (bad++ < 16)
+				printf("frame %u: ended on line %u, first %u pixels "
+				       "black\n", f, ly, i);
+		}
+	}
+	printf("%u frames, %u wrong\n", BENCH_HALT_FRAMES, bad);
+	gbem_free(g);
+	free(rom);
+	gb_select(was);
+	return bad != 0;
+}
+
+/* how tiles were decoded before tile_decode, a pixel at a time, to check
+ * it against and to compare its speed with */
+static void tile_decode_pixels(Byte *px, const Byte *vram_px, int flip) {
+	int x, y, cache_x, cache_y;
+	Byte colour;
+
+	for (y = 0; y < 8; y++) {
+		for (x = 0; x < 8; x++) {
+			colour  = (vram_px[y * 2] & (0x80 >> x)) >> (7 - x);
+			colour |= (vram_px[(y * 2) + 1] & (0x80 >> x)) >> (7 - x) << 1;
+			cache_x = (flip & X_FLIP) ? 7 - x : x;
+			cache_y = (flip & Y_FLIP) ? 7 - y : y;
+			px[cache_y * 8 + cache_x] = colour;
+		}
+	}
+}
+
+/* decode every flip of every tile in vram into tiles, over and over for
+ * the given time. Prints and returns tiles decoded per second */
+static double bench_tiles_with(const char *what,
+                               void (*decode)(Byte *, const Byte *, int),
+                               const Byte *vram, Byte *tiles, double seconds) {
+	unsigned long long decoded = 0;
+	double start, elapsed;
+	int i, flip;
+
+	start = now();
+	do {
+		for (i = 0; i < BENCH_TILES; i++)
+			for (flip = 0; flip < TILE_FLIPS; flip++)
+				decode(tiles + (i * TILE_FLIPS + flip) * TILE_PX, vram + i * 16, flip);
+		decoded += BENCH_TILES;
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	printf("%s: %.0f tiles/s, %.0f vram reloads/s\n", what,
+	       decoded / elapsed, decoded / elapsed / BENCH_TILES);
+	return decoded / elapsed;
+}
+
+static int bench_tiles(double seconds) {
+	Byte vram[BENCH_TILES * 16];
+	Byte *tiles, *want;
+	unsigned int i, seed = 1;
+	int bad;
+
+	tiles = malloc(BENCH_TILES * TILE_FLIPS * TILE_PX);
+	want = malloc(BENCH_TILES * TILE_FLIPS * TILE_PX);
+	for (i = 0; i < sizeof(vram); i++) {
+		seed = seed * 1103515245 + 12345;
+		vram[i] = seed >> 16;
+	}
+	bench_tiles_with("table", tile_decode, vram, tiles, seconds / 2);
+	bench_tiles_with("pixels", tile_decode_pixels, vram, want, seconds / 2);
+	bad = memcmp(tiles, want, BENCH_TILES * TILE_FLIPS * TILE_PX) != 0;
+	if (bad)
+		printf("the decoders disagree\n");
+	free(tiles);
+	free(want);
+	return bad;
+}
+
+/* how draw_scan_line resolved a line before, choosing a palette a pixel
+ * by the sprite bit and storing through put_pixel */
+static void draw_scan_line_pixels(Byte ly) {
+	int i;
+	Byte code;
+	for (i = 0; i < DISPLAY_W; i++) {
+		code = display.scan_line[i];
+		if (code & 0x20)
+			display.frame[ly * DISPLAY_W + i] = display.pal_colour[PAL_SPRITE + ((code >> 2) & 0x07) * 4 + (code & 0x03)];
+		else
+			display.frame[ly * DISPLAY_W + i] = display.pal_colour[((code >> 2) & 0x07) * 4 + (code & 0x03)];
+	}
+}
+
+/* resolve every line of a frame with draw, over and over for the given
+ * time. Prints and returns lines per second */
+static double bench_resolve_with(const char *what, void (*draw)(Byte),
+                                 double seconds) {
+	unsigned long long lines = 0;
+	double start, elapsed;
+	int ly;
+
+	start = now();
+	do {
+		for (ly = 0; ly < DISPLAY_H; ly++)
+			draw(ly);
+		lines += DISPLAY_H;
+		elapsed = now() - start;
+	} while (elapsed < seconds);
+
+	printf("%s: %.0f lines/s, enough for %.0f instances at 60 fps\n", what,
+	       lines / elapsed, lines / elapsed / (DISPLAY_H * 60));
+	return lines / elapsed;
+}
+
+static int bench_resolve(double seconds) {
+	Colour *want;
+	unsigned int i, seed = 1;
+	int bad;
+
+	display_init();
+	for (i = 0; i < PAL_ENTRIES; i++) {
+		seed = seed * 1103515245 + 12345;
+		display.pal_colour[i] = seed >> 8;
+	}
+	/* codes of background and sprite pixels, some with bg priority */
+	for (i = 0; i < DISPLAY_W; i++) {
+		seed = seed * 1103515245 + 12345;
+		display.scan_line[i] = (seed >> 16) & 0x7F;
+	}
+	display.draw_mode = DRAW_RGB;
+	bench_resolve_with("table", draw_scan_line, seconds / 2);
+	want = malloc(sizeof(display.frame));
+	memcpy(want, display.frame, sizeof(display.frame));
+	bench_resolve_with("pixels", draw_scan_line_pixels, seconds / 2);
+	bad = memcmp(want, display.frame, sizeof(display.frame)) != 0;
+	if (bad)
+		printf("the resolves disagree\n");
+	free(want);
+	display_fini();
+	return bad;
+}
+
+/* the rom file fn, or NULL if it can't be read */
+static Byte *bench_read(const char *fn, unsigned int *size) {
+	FILE *fp;
+	Byte *data;
+	long len;
+
+	fp = fopen(fn, "rb");
+	if (fp == NULL) {
+		perror(fn);
+		return NULL;
+	}
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data = malloc(len > 0 ? len : 1);
+	if (len <= 0 || fread(data, 1, len, fp) != (size_t)len) {
+		fprintf(stderr, "%s: read error\n", fn);
+		free(data);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+	*size = len;
+	return data;
+}
+
+/* run the rom for the given number of frames in a new instance, with the
+ * scripted input. Returns the cpu time taken, or -1 if it won't load. If
+ * instructions isn't NULL it is set to the instructions run. Frame hashes
+ * are taken throughout. If golden isn't NULL they are checked against that
+ * log, with diverged set to the first frame unlike it, or if is_new they
+ * are saved there instead */
+static double bench_rom_run(const Byte *data, unsigned int size,
+                            unsigned int frames, uint64_t *instructions,
+                            const char *golden, int is_new, long *diverged) {
+	GbInstance *g = gbem_new();
+	unsigned int f;
+	double start, elapsed;
+
+	if (gbem_load_rom(g, data, size) != 0 ||
+	    gbem_hash_start(g, is_new ? NULL : golden) != 0) {
+		gbem_free(g);
+		return -1;
+	}
+	start = now();
+	for (f = 0; f < frames; f++) {
+		gbem_set_buttons(g, bench_input[(f / BENCH_HOLD) % BENCH_INPUTS]);
+		gbem_run_frame(g);
+	}
+	elapsed = now() - start;
+	if (instructions != NULL)
+		*instructions = core.instructions;
+	if (diverged != NULL)
+		*diverged = gbem_hash_diverged(g);
+	if (golden != NULL && is_new)
+		gbem_hash_save(g, golden);
+	gbem_free(g);
+	return elapsed;
+}
+
+/* one line of csv for the rom. It is run three times: flat out for the
+ * timing, then with split.h timing each part of the machine, then with
+ * the debugging core counting instructions (which is much slower, and
+ * doesn't skip idle loops). instructions_per_s is the rate of that last
+ * run, over its own time. The split run reads the clock at every change
+ * of part, and that cost mostly lands in other, so other is largely the
+ * splitting itself rather than the scheduler or front end. With a
+ * golden_dir the frames of the timing run are checked against the rom's
+ * log there, or if it has none yet, a log is made to check later builds
+ * against */
+static int bench_rom_file(const char *fn, unsigned int frames, FILE *out) {
+	Byte *data;
+	unsigned int size;
+	uint64_t instructions = 0;
+	double elapsed, counting, total;
+	long diverged = -1;
+	char *golden = NULL;
+	const char *name, *check = "";
+	struct stat st;
+	int is_new = 0, i;
+
+	data = bench_read(fn, &size);
+	if (data == NULL)
+		return 1;
+
+	if (golden_dir != NULL) {
+		name = strrchr(fn, '/') ? strrchr(fn, '/') + 1 : fn;
+		golden = malloc(strlen(golden_dir) + strlen(name) + 5);
+		sprintf(golden, "%s/%s.fh", golden_dir, name);
+		is_new = stat(golden, &st) != 0;
+		check = is_new ? "new" : "match";
+	}
+	elapsed = bench_rom_run(data, size, frames, NULL, golden, is_new, &diverged);
+	free(golden);
+	if (elapsed < 0) {
+		fprintf(stderr, "%s: not a rom\n", fn);
+		free(data);
+		return 1;
+	}
+	split_start();
+	bench_rom_run(data, size, frames, NULL, NULL, 0, NULL);
+	split_stop();
+	core_count(1);
+	counting = bench_rom_run(data, size, frames, &instructions, NULL, 0, NULL);
+	core_count(0);
+	free(data);
+
+	total = 0;
+	for (i = 0; i < SPLITS; i++)
+		total += split_ns(i);
+	if (total == 0)
+		total = 1;
+	fprintf(out, "%s,%u,%.3f,%.1f,%.2f,%.0f,%.0f", fn, frames, elapsed,
+	        frames / elapsed, frames / elapsed / (4194304.0 / GB_FRAME_CYCLES),
+	        counting > 0 ? instructions / counting : 0, elapsed * 1e9 / frames);
+	for (i = SPLIT_CORE; i < SPLITS; i++)
+		fprintf(out, ",%.1f", split_ns(i) * 100 / total);
+	fprintf(out, ",%.1f,", split_ns(SPLIT_OTHER) * 100 / total);
+	if (diverged >= 0)
+		fprintf(out, "%ld\n", diverged);
+	else
+		fprintf(out, "%s\n", check);
+	fflush(out);
+	return 0;
+}
+
+static int compare_names(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+/* bench the .gb and .gbc files in a directory, in name order */
+static int bench_rom_dir(const char *dir, unsigned int frames, FILE *out) {
+	DIR *d;
+	struct dirent *ent;
+	char **names = NULL;
+	unsigned int count = 0, i;
+	int ret = 0;
+
+	d = opendir(dir);
+	if (d == NULL) {
+		perror(dir);
+		return 1;
+	}
+	while ((ent = readdir(d)) != NULL) {
+		const char *ext = strrchr(ent->d_name, '.');
+		if (ext == NULL || (strcmp(ext, ".gb") != 0 && strcmp(ext, ".gbc") != 0))
+			continue;
+		names = realloc(names, (count + 1) * sizeof(char *));
+		names[count] = malloc(strlen(dir) + strlen(ent->d_name) + 2);
+		sprintf(names[count], "%s/%s", dir, ent->d_name);
+		++count;
+	}
+	closedir(d);
+	qsort(names, count, sizeof(char *), compare_names);
+	for (i = 0; i < count; i++) {
+		ret |= bench_rom_file(names[i], frames, out);
+		free(names[i]);
+	}
+	free(names);
+	return ret;
+}
+
+/* gbem -b rom [-golden dir] [frames [report.csv [rom or dir ...]]].
+ * Loading and running roms prints all sorts to stdout, so the report is
+ * best given a file of its own; by default, or as -, it goes to stdout
+ * too */
+static int bench_roms(int argc, char *argv[]) {
+	unsigned int frames = BENCH_FRAMES;
+	const char *report = "-";
+	FILE *out = stdout;
+	struct stat st;
+	int ret = 0;
+	int i;
+
+	if (argc >= 2 && strcmp(argv[0], "-golden") == 0) {
+		golden_dir = argv[1];
+		argc -= 2;
+		argv += 2;
+	}
+	if (argc >= 1)
+		frames = atoi(argv[0]);
+	if (argc >= 2)
+		report = argv[1];
+	if (frames == 0) {
+		printf("frames must be at least 1\n");
+		return 1;
+	}
+	if (strcmp(report, "-") != 0) {
+		out = fopen(report, "w");
+		if (out == NULL) {
+			perror(report);
+			return 1;
+		}
+	}
+	if (out != stdout)
+		bench_config();
+	fprintf(out, "rom,frames,seconds,frames_per_s,x_realtime,"
+	        "instructions_per_s,ns_per_frame,execute_cycles,display_update,"
+	        "sound_update,timer_sync,other,golden\n");
+	/* the default rom always comes first, so every report has a row to
+	 * compare with the others */
+	for (i = 2; i < argc; i++)
+		if (strcmp(argv[i], BENCH_DEFAULT) == 0)
+			break;
+	if (i == argc)
+		ret = bench_rom_file(BENCH_DEFAULT, frames, out);
+	for (i = 2; i < argc; i++) {
+		if (stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode))
+			ret |= bench_rom_dir(argv[i], frames, out);
+		else
+			ret |= bench_rom_file(argv[i], frames, out);
+	}
+	if (out != stdout)
+		fclose(out);
+	return ret;
+}
+
+int bench_main(int argc, char *argv[]) {
+	const Bench *b;
+	double seconds = 3.0;
+
+	if (argc >= 3 && strcmp(argv[2], "rom") == 0)
+		return bench_roms(argc - 3, argv + 3);
+	if (argc >= 4)
+		seconds = atof(argv[3]);
+	for (b = benches; argc >= 3 && b->name != NULL; b++) {
+		if (strcmp(argv[2], b->name) == 0) {
+			int ret;
+			ret = b->run(seconds);
+			memory_fini();
+			return ret;
+		}
+	}
+	printf("%s -b test [seconds]\n", argv[0]);
+	for (b = benches; b->name != NULL; b++)
+		printf("  %-8s %s\n", b->name, b->description);
+	printf("%s -b rom [-golden dir] [frames [report.csv [rom or dir ...]]]\n",
+	       argv[0]);
+	printf("  %-8s %s\n", "rom", "run roms headless with scripted input, "
+	       "as csv (" BENCH_DEFAULT " first)");
+	return 1;
+}
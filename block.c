@@ -0,0 +1,167 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of jonny nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY jonny AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL jonny OR ANY OTHER
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include "block.h"
+#include "memory.h"
+
+#define E	0			/* ends a block */
+#define X	0xFF		/* never part of a block */
+#define CB	1			/* see cb_cycles */
+
+/* instruction length in bytes, including the opcode */
+const Byte op_length[256] = {
+	 1,  3,  1,  1,  1,  1,  2,  1,  3,  1,  1,  1,  1,  1,  2,  1,	/* 0_ */
+	 2,  3,  1,  1,  1,  1,  2,  1,  2,  1,  1,  1,  1,  1,  2,  1,	/* 1_ */
+	 2,  3,  1,  1,  1,  1,  2,  1,  2,  1,  1,  1,  1,  1,  2,  1,	/* 2_ */
+	 2,  3,  1,  1,  1,  1,  2,  1,  2,  1,  1,  1,  1,  1,  2,  1,	/* 3_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* 4_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* 5_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* 6_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* 7_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* 8_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* 9_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* A_ */
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,	/* B_ */
+	 1,  1,  3,  3,  3,  1,  2,  1,  1,  1,  3,  2,  3,  3,  2,  1,	/* C_ */
+	 1,  1,  3,  1,  3,  1,  2,  1,  1,  1,  3,  1,  3,  1,  2,  1,	/* D_ */
+	 2,  1,  1,  1,  1,  1,  2,  1,  2,  1,  3,  1,  1,  1,  2,  1,	/* E_ */
+	 2,  1,  1,  1,  1,  1,  2,  1,  2,  1,  3,  1,  1,  1,  2,  1	/* F_ */
+};
+
+/* cycles for each opcode. E marks instructions that end a block (their
+ * timing depends on whether a branch is taken), X ones that are never
+ * decoded into a block, and CB the prefixed page, looked up in cb_cycles */
+const Byte op_cycles[256] = {
+	 4, 12,  8,  8,  4,  4,  8,  4, 20,  8,  8,  8,  4,  4,  8,  4,	/* 0_ */
+	 E, 12,  8,  8,  4,  4,  8,  4,  E,  8,  8,  8,  4,  4,  8,  4,	/* 1_ */
+	 E, 12,  8,  8,  4,  4,  8,  4,  E,  8,  8,  8,  4,  4,  8,  4,	/* 2_ */
+	 E, 12,  8,  8, 12, 12, 12,  4,  E,  8,  8,  8,  4,  4,  8,  4,	/* 3_ */
+	 4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,	/* 4_ */
+	 4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,	/* 5_ */
+	 4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,	/* 6_ */
+	 8,  8,  8,  8,  8,  8,  E,  8,  4,  4,  4,  4,  4,  4,  8,  4,	/* 7_ */
+	 4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,	/* 8_ */
+	 4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,	/* 9_ */
+	 4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,	/* A_ */
+	 4,  4,  4,  4,  4,  4,  8,  4,  4,  4,  4,  4,  4,  4,  8,  4,	/* B_ */
+	 E, 12,  E,  E,  E, 16,  8,  E,  E,  E,  E, CB,  E,  E,  8,  E,	/* C_ */
+	 E, 12,  E,  X,  E, 16,  8,  E,  E,  E,  E,  X,  E,  X,  8,  E,	/* D_ */
+	12, 12,  8,  X,  X, 16,  8,  E, 16,  E, 16,  X,  X,  X,  8,  E,	/* E_ */
+	12, 12,  8,  4,  X, 16,  8,  E, 12,  8, 16,  E,  X,  X,  8,  E	/* F_ */
+};
+
+/* cycles for each 0xCB prefixed opcode */
+const Byte cb_cycles[256] = {
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* 0_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* 1_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* 2_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* 3_ */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 4_ */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 5_ */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 6_ */
+	 8,  8,  8,  8,  8,  8, 12,  8,  8,  8,  8,  8,  8,  8, 12,  8,	/* 7_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* 8_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* 9_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* A_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* B_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* C_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* D_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8,	/* E_ */
+	 8,  8,  8,  8,  8,  8, 16,  8,  8,  8,  8,  8,  8,  8, 16,  8	/* F_ */
+};
+
+/* opcodes after which a running block checks whether to stop: those that
+ * may write memory (and so change IF, IE or the rom bank), and those that
+ * may read DIV or TIMA, which brings the timer up to date and so can raise
+ * an interrupt (see read_high) */
+static const Byte op_checks[256] = {
+	0, 0, 1, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0,	/* 0_ */
+	0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,	/* 1_ */
+	0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0,	/* 2_ */
+	0, 0, 1, 0, 1, 1, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0,	/* 3_ */
+	0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0,	/* 4_ */
+	0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0,	/* 5_ */
+	0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0,	/* 6_ */
+	1, 1, 1, 1, 1, 1, 0, 1, 0, 0, 0, 0, 0, 0, 1, 0,	/* 7_ */
+	0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0,	/* 8_ */
+	0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0,	/* 9_ */
+	0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0,	/* A_ */
+	0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0,	/* B_ */
+	0, 0, 0, 0, 1, 1, 0, 1, 0, 0, 0, 0, 1, 1, 0, 1,	/* C_ */
+	0, 0, 0, 0, 1, 1, 0, 1, 0, 0, 0, 0, 1, 0, 0, 1,	/* D_ */
+	1, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1,	/* E_ */
+	1, 0, 1, 0, 0, 1, 0, 1, 0, 0, 1, 0, 0, 0, 0, 1	/* F_ */
+};
+
+#undef E
+#undef X
+#undef CB
+
+void block_flush(void) {
+	int i;
+	/* 0xFFFF is never a rom address, so it can't match a lookup */
+	for (i = 0; i < BLOCK_CACHE_SIZE; i++)
+		block_cache[i].pc = 0xFFFF;
+}
+
+void block_bank_switched(void) {
+	block_abort = 1;
+}
+
+void block_decode(Block *b, Word pc, unsigned int bank) {
+	/* a block never runs off the end of the bank it started in */
+	unsigned int end = (pc < MEM_ROM_BANK_SW) ? MEM_ROM_BANK_SW : MEM_VIDEO;
+	unsigned int addr = pc;
+	MicroOp *op;
+
+	b->pc = pc;
+	b->bank = bank;
+	b->count = 0;
+	while (b->count < BLOCK_MAX_OPS) {
+		Byte opcode = readb(addr);
+		Byte c = op_cycles[opcode];
+		if (c == 0xFF || addr + op_length[opcode] > end)
+			break;
+		op = &b->ops[b->count++];
+		op->opcode = opcode;
+		op->length = op_length[opcode];
+		if (op->length == 3)
+			op->imm = readw(addr + 1);
+		else if (op->length == 2)
+			op->imm = readb(addr + 1);
+		else
+			op->imm = 0;
+		op->checks = op_checks[opcode];
+		/* of the prefixed page, only the (HL) forms touch memory */
+		if (opcode == 0xCB)
+			op->checks = (op->imm & 0x07) == 0x06;
+		addr += op->length;
+
+		if (c == 0)
+			break;
+	}
+}
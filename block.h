@@ -0,0 +1,96 @@
+/*
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of jonny nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY jonny AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL jonny OR ANY OTHER
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, 
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _BLOCK_H
+#define _BLOCK_H
+
+#include "gbem.h"
+#include "cart.h"
+
+/* predecoded basic blocks of rom code, for CORE_BLOCK_CACHE (see
+ * config.h). A block is a straight run of instructions from one rom bank,
+ * ending at the first branch, HALT, STOP or EI, the end of the bank, or
+ * after BLOCK_MAX_OPS instructions. */
+
+#define BLOCK_MAX_OPS		16
+#define BLOCK_CACHE_SIZE	4096	/* must be a power of two */
+
+typedef struct {
+	Byte opcode;
+	Byte length;
+	Byte checks;		/* may write memory or read the timer, see op_checks */
+	Word imm;			/* operand bytes, if any */
+} MicroOp;
+
+typedef struct {
+	Word pc;
+	unsigned int bank;	/* rom bank and block the code was decoded from */
+	int count;			/* number of ops, 0 if pc can't start a block */
+	MicroOp ops[BLOCK_MAX_OPS];
+} Block;
+
+typedef struct {
+	Block blocks[BLOCK_CACHE_SIZE];
+	/* set when the rom bank changes while a block is running, so the core
+	 * stops executing ops decoded from the old bank */
+	int abort;
+} BlockCache;
+
+/* the block cache of the selected instance, see instance.h */
+extern __thread BlockCache *gb_blocks;
+#define block_cache		(gb_blocks->blocks)
+#define block_abort		(gb_blocks->abort)
+
+extern const Byte op_length[256];
+extern const Byte op_cycles[256];
+extern const Byte cb_cycles[256];
+
+void block_flush(void);
+void block_decode(Block *b, Word pc, unsigned int bank);
+void block_bank_switched(void);
+
+static inline unsigned int block_bank(Word pc);
+static inline Block *block_lookup(Word pc);
+
+/* the rom bank code at pc is currently mapped from */
+static inline unsigned int block_bank(Word pc) {
+	/* bank 0 is fixed, only the upper half depends on the mbc state */
+	if (pc < MEM_ROM_BANK_SW)
+		return 0;
+	return cart.rom_bank | (cart.rom_block << 16);
+}
+
+static inline Block *block_lookup(Word pc) {
+	unsigned int bank = block_bank(pc);
+	Block *b;
+
+	b = &block_cache[(pc ^ (bank << 6)) & (BLOCK_CACHE_SIZE - 1)];
+	if (b->pc != pc || b->bank != bank)
+		block_decode(b, pc, bank);
+	return b;
+}
+
+#endif	//_BLOCK_H
@@ -31,8 +31,10 @@
 #include <assert.h>
 #include "cart.h"
 #include "memory.h"
+#include "core.h"
 #include "rtc.h"
 #include "save.h"
+#include "block.h"
 
 
 static void set_switchable_rom(void);
@@ -40,23 +42,18 @@ static void set_switchable_ram(void);
 static void save_sram(void);
 static int find_sram_file(void);
 static void load_sram(void);
+static int setup_rom(const char *fn);
 
 static const char ram_ext[] = ".sav";
 
-Cart cart;
-
-static const Byte sg_data[] ="\xce\xed\x66\x66\xcc\x0d\x00\x0b\x03\x73\x00\x83"
-                             "\x00\x0c\x00\x0d\x00\x08\x11\x1f\x88\x89\x00\x0e"
-                             "\xdc\xcc\x6e\xe6\xdd\xdd\xd9\x99\xbb\xbb\x67\x63"
-                             "\x6e\x0e\xec\xcc\xdd\xdc\x99\x9f\xbb\xb9\x33\x3e";
-
-extern int console;
-extern int console_mode;
+/* every rom carries this at CART_SG_DATA, see setup_rom() */
+const Byte sg_data[] = "\xce\xed\x66\x66\xcc\x0d\x00\x0b\x03\x73\x00\x83"
+                       "\x00\x0c\x00\x0d\x00\x08\x11\x1f\x88\x89\x00\x0e"
+                       "\xdc\xcc\x6e\xe6\xdd\xdd\xd9\x99\xbb\xbb\x67\x63"
+                       "\x6e\x0e\xec\xcc\xdd\xdc\x99\x9f\xbb\xb9\x33\x3e";
 
 int load_rom(const char* fn) {
-	int i;
 	size_t c;
-	int title_len;
 	struct stat fstats;
 	FILE *rom_file;
 	// check that rom is not already loaded
@@ -100,16 +97,65 @@ int load_rom(const char* fn) {
 	}
 	
 	fclose(rom_file);
+	return setup_rom(fn);
+}
+
+/* load a rom the caller already has in memory. The data is copied. With
+ * no file name to go by there is no sram file, so the cart ram starts
+ * empty and isn't saved */
+int load_rom_buffer(const void *data, unsigned int size) {
+	assert(cart.is_loaded == 0);
+
+	if (size < 32 * 1024) {
+		fprintf(stderr, "rom error: roms cannot be smaller than 32kB\n");
+		return -1;
+	}
+	cart.rom_size = size;
+	cart.rom = malloc(cart.rom_size);
+	if (cart.rom == NULL) {
+		fprintf(stderr, "rom loading failed.\n");
+		perror("malloc");
+		cart.rom_size = 0;
+		return -1;
+	}
+	memcpy(cart.rom, data, cart.rom_size);
+	return setup_rom(NULL);
+}
+
+/* like load_rom_buffer(), but the rom is used where it is rather than
+ * copied, so instances running the same rom can share one image. It must
+ * stay put and unchanged until the rom is unloaded */
+int load_rom_shared(const void *data, unsigned int size) {
+	assert(cart.is_loaded == 0);
+
+	if (size < 32 * 1024) {
+		fprintf(stderr, "rom error: roms cannot be smaller than 32kB\n");
+		return -1;
+	}
+	cart.rom_size = size;
+	cart.rom = (Byte *)data;
+	cart.is_rom_shared = 1;
+	return setup_rom(NULL);
+}
+
+/* check the rom in cart.rom and set the cart up for it. fn is the file it
+ * came from, if any */
+static int setup_rom(const char *fn) {
+	int i;
+	int title_len;
+
 	// test if rom is valid, by checking the scrolling graphic data
 	for (i = 0; i < CART_ROM_TITLE - CART_SG_DATA; ++i) {
 		if (cart.rom[CART_SG_DATA + i] != sg_data[i]) {
 			fprintf(stderr, "invalid rom: scrolling graphic mismatch\n");
-			free(cart.rom);
+			if (!cart.is_rom_shared)
+				free(cart.rom);
+			cart.is_rom_shared = 0;
 			return -1;
 		}
 	}
 	// check and get rom title
-	printf("rom %s loaded (%u bytes)\n", fn, cart.rom_size);
+	printf("rom %s loaded (%u bytes)\n", fn != NULL ? fn : "image", cart.rom_size);
 	title_len = strlen((char *)cart.rom + CART_ROM_TITLE);
 	if (title_len > 17) {
 		fprintf(stderr, "invalid rom: title too long (>16 characters)\n");
@@ -338,8 +384,10 @@ int load_rom(const char* fn) {
 	printf("\tmbc: %u\trom size: %u\tram size:%u\n", cart.mbc, 
 	    		cart.rom_size, cart.ram_size);
 	
-	cart.rom_fn = malloc(sizeof(char) * (strlen(fn) + 1));
-	strcpy(cart.rom_fn, fn);
+	if (fn != NULL) {
+		cart.rom_fn = malloc(sizeof(char) * (strlen(fn) + 1));
+		strcpy(cart.rom_fn, fn);
+	}
 
 	if (cart.mbc == 3) {
 		cart.mbc_reg_page = malloc(SIZE_RAM_BANK_SW);
@@ -382,10 +430,12 @@ void cart_reset(void) {
 void unload_rom(void) {
 	// check that rom is already loaded
 	assert(cart.is_loaded == 1);
-	if ((cart.ram_size > 0) || (cart.mbc == 3))
+	if (((cart.ram_size > 0) || (cart.mbc == 3)) && cart.rom_fn != NULL)
 		save_sram();
 	free(cart.ram);
-	free(cart.rom);
+	if (!cart.is_rom_shared)
+		free(cart.rom);
+	cart.is_rom_shared = 0;
 	free(cart.rom_title);
 	free(cart.rom_fn);
 	cart.ram = 0;
@@ -399,6 +449,9 @@ void unload_rom(void) {
 static void set_switchable_rom(void) {
 	set_vector_block(MEM_ROM_BANK_SW, cart.rom + (cart.rom_bank * 0x4000) + 
 						(cart.rom_block * 0x80000), SIZE_ROM_BANK_SW);
+#ifdef CORE_BLOCK_CACHE
+	block_bank_switched();
+#endif
 }
 
 static void set_switchable_ram(void) {
@@ -608,6 +661,8 @@ static void save_sram(void) {
 int find_sram_file(void) {
 	char *fn;
 	struct stat fstats;
+	if (cart.rom_fn == NULL)
+		return 0;
 	fn = malloc(strlen(cart.rom_fn) + strlen(ram_ext) + 1);
 	strcpy(fn, cart.rom_fn);
 	strcat(fn, ram_ext);
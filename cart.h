@@ -52,6 +52,7 @@
 
 typedef struct {
 	Byte *rom;
+	int is_rom_shared;		/* rom belongs to the caller, see load_rom_shared() */
 	Byte *ram;
 	char *rom_title;
 	char *rom_fn;
@@ -65,7 +66,15 @@ typedef struct {
 	Byte *mbc_reg_page;
 } Cart;
 
+/* the cart in the selected instance, see instance.h */
+extern __thread Cart *gb_cart;
+#define cart	(*gb_cart)
+
+extern const Byte sg_data[];
+
 int load_rom(const char* fn);
+int load_rom_buffer(const void *data, unsigned int size);
+int load_rom_shared(const void *data, unsigned int size);
 void unload_rom(void);
 void cart_reset(void);
 void write_rom(Word address, Byte value);
@@ -78,7 +87,6 @@ static inline void write_cart_ram(Word address, Byte value);
 static inline Byte read_cart_ram(Word address);
 
 static inline void write_cart_ram(Word address, Byte value) {
-	extern Cart cart;
 
 	switch (cart.mbc) {
 		case 2:
@@ -97,7 +105,6 @@ static inline void write_cart_ram(Word address, Byte value) {
 }
 
 static inline Byte read_cart_ram(Word address) {
-	extern Cart cart;
 	return cart.ram[address + (cart.ram_bank * 0x2000)];
 }
 
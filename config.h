@@ -35,6 +35,32 @@
  * designed with endianness (somewhat) in mind */
 /* #  define WORDS_BIGENDIAN */
 
+/* define this to build the cpu core with threaded dispatch (a jump table of
+ * label addresses) instead of a switch. Requires gcc or clang, as it uses
+ * the labels as values extension */
+/* #  define CORE_THREADED */
+
+/* define this to run rom code from a cache of predecoded basic blocks,
+ * rather than fetching and decoding every instruction through the memory
+ * map. Works with either dispatch engine */
+/* #  define CORE_BLOCK_CACHE */
+
+/* define this to keep the cpu flags lazily: 8bit adds and subtracts only
+ * record their operands, and Z/N/H/C are worked out when something reads
+ * them (conditional jumps, PUSH AF, DAA, adc/sbc, savestates) */
+/* #  define CORE_LAZY_FLAGS */
+
+/* define this to take the results and flags of the 8bit alu ops from
+ * tables built at startup (alu.c, about 525K) instead of working them out.
+ * With CORE_LAZY_FLAGS as well, add and subtract stay lazy and only daa
+ * and the rotates and shifts use the tables */
+/* #  define CORE_ALU_TABLES */
+
+/* define this to build without sdl. Only the null backend (see backend.h)
+ * is left, as if every run was given -headless: no window, no sound, no
+ * input, and no keeping to real time */
+/* #  define GBEM_NO_SDL */
+
 /* commented out these unused defines. Without these headers, some
  * porting will be necessary */
 #if 0
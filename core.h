@@ -50,19 +50,53 @@ typedef struct {
 		Word reg_sp, reg_pc;
 		/* zero, subtract, half carry and carry flags */
 		int flag_z, flag_n, flag_h, flag_c;
+#ifdef CORE_LAZY_FLAGS
+		/* last 8bit add/subtract, see CORE_LAZY_FLAGS */
+		unsigned int lazy_flags, lazy_ab, lazy_res;
+		int lazy_sub;
+#endif
 		int ei;
 		int is_halted, is_stopped, ime;
+		/* IF & IE, and the same again but only while IME is set, see
+		 * update_ints() */
+		unsigned int int_pending, int_ready;
 		unsigned int frequency;
+		/* hardware being emulated and the mode the cart runs it in */
+		int console, console_mode;
+		/* instructions run, only counted by the debugging version of
+		 * execute_cycles, see core_count() */
+		uint64_t instructions;
+		/* cycles run, counted as they run so the time is known in the
+		 * middle of execute_cycles, see sched_time() */
+		uint64_t cycles;
 } CoreState;
 
-int execute_cycles(int max_cycles);
+/* the cpu of the selected instance, see instance.h */
+extern __thread CoreState *gb_core;
+#define core			(*gb_core)
+#define console			(gb_core->console)
+#define console_mode	(gb_core->console_mode)
+
+extern int (*execute_cycles)(int max_cycles);
+void core_debug(int on);
+void core_count(int on);
+void core_profile(int on);
 void core_reset(void);
 void dump_state(void);
 void core_save(void);
 void core_load(void);
 
+/* work out which interrupts are waiting to be taken. Must be called
+ * whenever IF, IE or IME change, so the core doesn't have to read them
+ * before every instruction */
+static inline void update_ints(void) {
+	core.int_pending = read_io(HWREG_IF) & read_io(HWREG_IE) & 0x1F;
+	core.int_ready = core.ime ? core.int_pending : 0;
+}
+
 static inline void raise_int(Byte interrupt) {
-	writeb(HWREG_IF, readb(HWREG_IF) | interrupt);
+	write_io(HWREG_IF, read_io(HWREG_IF) | interrupt);
+	update_ints();
 }
 
 #endif  // _CORE_H
@@ -37,6 +37,7 @@
 #include "debug.h"
 #include "memory.h"
 #include "cart.h"
+#include "core.h"
 
 static char *replace_substring(char *string, const char *substring_1, 
                         const char *substring_2);
@@ -49,6 +50,13 @@ static int *length;
 static int *cycles;
 static int entries;
 
+static Word breakpoints[DEBUG_MAX_POINTS];
+static int breakpoint_count;
+static Word watchpoints[DEBUG_MAX_POINTS];
+/* last value seen at each watchpoint, -1 before the first check */
+static int watch_values[DEBUG_MAX_POINTS];
+static int watchpoint_count;
+
 void debug_init() {
 	char buffer[256];
 	char name[6];
@@ -97,7 +105,6 @@ void disasm_exec(Word address) {
 	unsigned int opcode_size;
 	char buffer[16];
     char *temp;
-	extern Cart cart;
 	fprintf(stdout, "%04hx:%02hhx:\t", address, cart.rom_bank + (cart.rom_block * 0x20));
 	for (i = 0; i < entries; i++) {
 		if (opcode == opcodes[i])
@@ -147,7 +154,6 @@ static void disasm_instr(Byte *rom, unsigned int address) {
 	unsigned int opcode_size;
 	char buffer[16];
     char *temp;
-	extern Cart cart;
 	Word word;
 	fprintf(stdout, "%08x:\t", address);
 	for (i = 0; i < entries; i++) {
@@ -193,6 +199,105 @@ static void disasm_instr(Byte *rom, unsigned int address) {
 	//fprintf(stdout, "");
 }
 
+/* the table entry for the instruction at code, or -1. Unlike the above
+ * this knows the 0xCB page, where the table has only bit 0 of BIT, RES and
+ * SET, with ! for the bit */
+static int find_instr(const Byte *code, unsigned int *bit) {
+	int i;
+	unsigned int opcode = code[0];
+	*bit = 0;
+	if (opcode == 0xCB) {
+		opcode = code[1];
+		if (opcode >= 0x40) {
+			*bit = (opcode >> 3) & 0x07;
+			opcode &= 0xC7;
+		}
+		opcode = (opcode << 8) | 0xCB;
+	}
+	for (i = 0; i < entries; i++) {
+		if (opcode == opcodes[i])
+			return i;
+	}
+	return -1;
+}
+
+/* the operands of entry i with ! filled in, to be freed */
+static char *instr_operands(int i, unsigned int bit) {
+	char value[16];
+	char *operand;
+	if (strcmp(operands[i], "\"\"") == 0) {
+		operand = malloc(1);
+		operand[0] = '\0';
+		return operand;
+	}
+	if (strstr(operands[i], "!") != NULL) {
+		snprintf(value, 16, "%u", bit);
+		return replace_substring(operands[i], "!", value);
+	}
+	operand = malloc(strlen(operands[i]) + 1);
+	strcpy(operand, operands[i]);
+	return operand;
+}
+
+/* the instruction at code, as text, into buf */
+void disasm_string(const Byte *code, char *buf, int size) {
+	int i;
+	unsigned int opcode_size;
+	unsigned int bit;
+	char value[16];
+	char *operand, *temp;
+	i = find_instr(code, &bit);
+	if (i < 0) {
+		snprintf(buf, size, "db %02x", code[0]);
+		return;
+	}
+	opcode_size = (opcodes[i] / 0x100) + 1;
+	operand = instr_operands(i, bit);
+	if (strstr(operand, "*") != NULL) {
+		if ((length[i] - opcode_size) == 1)
+			snprintf(value, 16, "%02hhx", code[opcode_size]);
+		else
+			snprintf(value, 16, "%04hx", code[opcode_size] | (code[opcode_size + 1] << 8));
+		temp = replace_substring(operand, "*", value);
+		free(operand);
+		operand = temp;
+	}
+	if (strstr(operand, "@") != NULL) {
+		snprintf(value, 16, "%02hhX", code[opcode_size]);
+		temp = replace_substring(operand, "@", value);
+		free(operand);
+		operand = temp;
+	}
+	if (operand[0] == '\0')
+		snprintf(buf, size, "%s", mnemonics[i]);
+	else
+		snprintf(buf, size, "%s %s", mnemonics[i], operand);
+	free(operand);
+}
+
+/* the same, but as the table has it, with * and @ for the immediates */
+void disasm_opcode(const Byte *code, char *buf, int size) {
+	int i;
+	unsigned int bit;
+	char *operand;
+	i = find_instr(code, &bit);
+	if (i < 0) {
+		snprintf(buf, size, "db %02x", code[0]);
+		return;
+	}
+	operand = instr_operands(i, bit);
+	if (operand[0] == '\0')
+		snprintf(buf, size, "%s", mnemonics[i]);
+	else
+		snprintf(buf, size, "%s %s", mnemonics[i], operand);
+	free(operand);
+}
+
+/* non zero once debug_init() has read the table */
+int disasm_loaded(void) {
+	return entries > 0;
+}
+
 static unsigned size_instr(Byte *rom, unsigned int address) {
 	int i;
 	unsigned int opcode = rom[address];
@@ -229,7 +334,6 @@ static char *replace_substring(char *string, const char *substring_1,
 }
 
 void disasm() {
-	extern Cart cart;
 	unsigned pc = 0;
 	while (pc < cart.rom_size) {
 		disasm_instr(cart.rom, pc);
@@ -238,3 +342,60 @@ void disasm() {
 	}
 }
 
+int debug_add_breakpoint(Word address) {
+	if (breakpoint_count == DEBUG_MAX_POINTS) {
+		fprintf(stderr, "too many breakpoints\n");
+		return 1;
+	}
+	breakpoints[breakpoint_count++] = address;
+	return 0;
+}
+
+int debug_add_watchpoint(Word address) {
+	if (watchpoint_count == DEBUG_MAX_POINTS) {
+		fprintf(stderr, "too many watchpoints\n");
+		return 1;
+	}
+	watchpoints[watchpoint_count] = address;
+	watch_values[watchpoint_count] = -1;
+	watchpoint_count++;
+	return 0;
+}
+
+int debug_points(void) {
+	return breakpoint_count + watchpoint_count;
+}
+
+/* about to execute the instruction at pc. Stops (until return is pressed)
+ * and returns 1 if it has a breakpoint on it */
+int debug_break(Word pc) {
+	int i;
+
+	for (i = 0; i < breakpoint_count; i++) {
+		if (breakpoints[i] == pc) {
+			fprintf(stdout, "breakpoint %04hx:%02hhx\n", pc,
+					cart.rom_bank + (cart.rom_block * 0x20));
+			dump_state();
+			getchar();
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* an instruction has just run. Returns 1 if it changed any of the watched
+ * bytes */
+int debug_watch(void) {
+	int i, value, hit = 0;
+
+	for (i = 0; i < watchpoint_count; i++) {
+		value = readb(watchpoints[i]);
+		if (watch_values[i] != -1 && value != watch_values[i]) {
+			fprintf(stdout, "watchpoint %04hx: %02x -> %02x\n", watchpoints[i],
+					watch_values[i], value);
+			hit = 1;
+		}
+		watch_values[i] = value;
+	}
+	return hit;
+}
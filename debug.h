@@ -35,8 +35,21 @@
 
 #include "gbem.h"
 
+#define DEBUG_MAX_POINTS	16
+
 void disasm_exec(Word address);
 void debug_init();
 void disasm();
+void disasm_string(const Byte *code, char *buf, int size);
+void disasm_opcode(const Byte *code, char *buf, int size);
+int disasm_loaded(void);
+
+/* breakpoints and watchpoints, checked by the debugging version of
+ * execute_cycles (see core.c) */
+int debug_add_breakpoint(Word address);
+int debug_add_watchpoint(Word address);
+int debug_points(void);
+int debug_break(Word pc);
+int debug_watch(void);
 
 #endif  // _DEBUG_H
@@ -26,6 +26,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <math.h>
 #include "gbem.h"
@@ -33,40 +34,39 @@
 #include "memory.h"
 #include "core.h"
 #include "save.h"
-#include "scale.h"
+#include "sched.h"
 
 
 #define	ALL		-1
 
-static void draw_scan_line(Byte ly);
+static unsigned int next_mode_change(void);
+static void display_step(unsigned int cycles);
 static void clear_scan_line();
 static void draw_background(const Byte lcdc, const Byte ly);
 static void draw_gbc_background(const Byte lcdc, const Byte ly);
 static void draw_window(const Byte lcdc, const Byte ly);
 static void draw_gbc_window(const Byte lcdc, const Byte ly);
 static void launch_hdma(int length);
+static void draw_line(const Byte lcdc, const Byte ly);
+static void draw_frame(const Byte lcdc);
 static void draw_sprites(const Byte lcdc, const Byte ly);
 static void draw_gbc_sprites(const Byte lcdc, const Byte ly);
 static inline Byte get_sprite_x(const unsigned int sprite);
 static inline Byte get_sprite_y(const unsigned int sprite);
 static inline Byte get_sprite_pattern(const unsigned int sprite);
 static inline Byte get_sprite_flags(const unsigned int sprite);
-static inline Uint32 get_pixel(const SDL_Surface *surface, const int x, 
-						const int y);
-static inline void put_pixel(const SDL_Surface *surface, const int x, 
-    					const int y, const Uint32 pixel);
-static void fill_rectangle(SDL_Surface *surface, const int x, const int y, 
-						const int w, const int h, 
-						const unsigned int colour);
-
-static void tile_init(Tile *t, Byte* vram_px, Tile *next);
-static void tile_fini(Tile *t);
+static void find_sprite_lines(void);
+static void clear_frame(void);
+
+static void tile_init(Tile *t, Byte* vram_px, Byte *cache_px, Tile *next);
 static void tile_regenerate(Tile *t, const int flip);
 static void tile_blit(Tile *t, const int x, const int line, const int flip, const int pal, const int priority);
 static void sprite_blit(Tile *t, const int x, const int line, const int flip, const int pal, const int priority, const int h);
 
 static Colour map_rgb(uint8_t r, uint8_t g, uint8_t b);
 static Colour translate_gbc_rgb(uint8_t r, uint8_t g, uint8_t b);
+static Byte gbc_shade(uint8_t r, uint8_t g, uint8_t b);
+static void set_mono_palette(unsigned int first, Byte p);
 
 enum { TILE_PALETTE 	= 0x07 };
 enum { TILE_VRAM_BANK 	= 0x08 };
@@ -74,39 +74,8 @@ enum { TILE_X_FLIP 		= 0x20 };
 enum { TILE_Y_FLIP 		= 0x40 };
 enum { TILE_PRIORITY 	= 0x80 };
 
-Display display;
-extern int console;
-extern int console_mode;
 
 void display_init(void) {
-	display.x_res = DISPLAY_W * 4;
-	display.y_res = DISPLAY_H * 4;
-	display.bpp = 32;
-
-	display.screen = SDL_SetVideoMode(display.x_res, display.y_res, display.bpp, SDL_SWSURFACE);
-	if (display.screen == NULL) {
-		fprintf(stderr, "video mode initialisation failed\n");
-		exit(1);
-	}
-	
-	#ifdef WINDOWS
-		// redirecting the standard input/output to the console 
-		// is required with windows.
-		activate_console(); 
-	#endif // WINDOWS
-
-	printf("sdl video initialised.\n");
-	SDL_WM_SetCaption("gbem", "gbem");
-
-	display.display = SDL_CreateRGBSurface(SDL_SWSURFACE, 
-                                 DISPLAY_W, DISPLAY_H, display.bpp, 0, 0, 0, 0);
-	if (display.display == NULL) {
-		fprintf(stderr, "could not create surface\n");
-		exit(1);
-	}
-
-	//display.display = SDL_DisplayFormat(display.display);
-
 	display.mono_colours[0] = map_rgb(0xff, 0xff, 0xff);
 	display.mono_colours[1] = map_rgb(0xaa, 0xaa, 0xaa);
 	display.mono_colours[2] = map_rgb(0x55, 0x55, 0x55);
@@ -124,20 +93,13 @@ void display_init(void) {
 }
 
 void display_fini(void) {
-	int i;
-	for (i = 0; i < display.cache_size; i++) {
-		tile_fini(&display.tiles_tdt_0[i]);
-	}
-	for (i = 0; i < display.cache_size; i++) {
-		tile_fini(&display.tiles_tdt_1[i]);
-	}
-	SDL_FreeSurface(display.display);
 	if (display.vram != NULL)
 		free(display.vram);
 	if (display.oam != NULL)
 		free(display.oam);
 	free(display.tiles_tdt_0);
 	free(display.tiles_tdt_1);
+	free(display.tile_arena);
 	
 	free(display.gbc_bg_pal_mem);
 	free(display.gbc_spr_pal_mem);
@@ -147,6 +109,11 @@ void display_fini(void) {
 
 void display_reset(void) {
 	int i;
+	/* lines still put off belong to the old state, see gbem_reset() */
+	display.due_start = display.due_end = 0;
+	/* a reset may come with the last game's memory still allocated */
+	free(display.vram);
+	free(display.oam);
 	if ((console == CONSOLE_GBC) || (console == CONSOLE_GBA)) {
 		display.vram = malloc(sizeof(Byte) * VRAM_SIZE_GBC);
 		memset(display.vram, 0, VRAM_SIZE_GBC);
@@ -158,6 +125,7 @@ void display_reset(void) {
 	display.vram_bank = 0;
 	display.oam = malloc(sizeof(Byte) * SIZE_OAM);
 	memset(display.oam, 0, SIZE_OAM);
+	display.is_sprite_lines_due = 1;
 	set_vector_block(MEM_VIDEO, display.vram + (display.vram_bank * 0x2000), SIZE_VIDEO);
 	set_vector_block(MEM_OAM, display.oam, 0x100);
 	
@@ -167,12 +135,23 @@ void display_reset(void) {
 		display.cache_size = 256;
 	}
 
+	free(display.tiles_tdt_0);
+	free(display.tiles_tdt_1);
+	free(display.tile_arena);
 	display.tiles_tdt_0 = malloc(sizeof(Tile) * display.cache_size);
 	display.tiles_tdt_1 = malloc(sizeof(Tile) * display.cache_size);
+	/* every flip of every tile is decoded into one block, allocated here
+	 * once, so drawing never touches the heap. Each decoded tile fills a
+	 * cache line, and a tile's flips are together */
+	if (posix_memalign((void **)&display.tile_arena, TILE_PX,
+	                   display.cache_size * 2 * TILE_FLIPS * TILE_PX) != 0) {
+		fprintf(stderr, "couldn't allocate the tile cache\n");
+		exit(1);
+	}
 	
 	for (i = 0; i < display.cache_size; i++) {
-		tile_init(&display.tiles_tdt_0[i], display.vram + ((i % 256) * 16) + ((i / 256) * 0x2000), &display.tiles_tdt_0[i + 1]);
-		tile_init(&display.tiles_tdt_1[i], display.vram + ((i % 256) * 16) + 0x0800 + ((i / 256) * 0x2000), &display.tiles_tdt_1[i + 1]);
+		tile_init(&display.tiles_tdt_0[i], display.vram + ((i % 256) * 16) + ((i / 256) * 0x2000), display.tile_arena + (i * TILE_FLIPS * TILE_PX), &display.tiles_tdt_0[i + 1]);
+		tile_init(&display.tiles_tdt_1[i], display.vram + ((i % 256) * 16) + 0x0800 + ((i / 256) * 0x2000), display.tile_arena + ((display.cache_size + i) * TILE_FLIPS * TILE_PX), &display.tiles_tdt_1[i + 1]);
 	}
 
 	/* FIXME for non gbc mode only */
@@ -190,9 +169,23 @@ void display_reset(void) {
 
 	display.sprite_height = 8;
 	display.cycles = 0;	
+	display.time = sched.now;
 	display.is_hdma_active = 0;
-	SDL_FillRect(display.display, NULL, SDL_MapRGB(display.display->format, 0xff, 0xff, 0xff));
-	SDL_FillRect(display.screen, NULL, SDL_MapRGB(display.screen->format, 0xff, 0xff, 0xff));
+	sched_after(SCHED_DISPLAY, 0);
+	clear_frame();
+}
+
+/* draw nothing, for frames no one will see, until told otherwise or the
+ * lcd is turned on. Drawing has no effect on the rest of the machine, and
+ * the next frame seen comes out as it would have anyway, as long as
+ * skipping stops at the end of a vblank or with the lcd off: the lines
+ * skipped are blanked before any more are drawn. A frame started by
+ * turning the lcd on may not reach vblank before skipping stops, so it is
+ * drawn */
+void display_skip(unsigned int is_skipping) {
+	display.is_skipping = is_skipping;
+	if (!is_skipping && display.is_clear_due)
+		clear_frame();
 }
 
 void set_vram_bank(unsigned int bank) {
@@ -201,17 +194,91 @@ void set_vram_bank(unsigned int bank) {
 }
 
 void set_lcdc(Byte value) {
+	if (value != read_io(HWREG_LCDC))
+		display_changing();
 	/* if lcd is being turned on/off set ly to 0 and blank the screen */
 	if ((value & 0x80) != (read_io(HWREG_LCDC) & 0x80)) {
 		write_io(HWREG_LY, 0);
-		SDL_FillRect(display.display, NULL, SDL_MapRGB(display.display->format, 0xff, 0xff, 0xff));
+		if (value & 0x80)
+			display.is_skipping = 0;
+		clear_frame();
+		/* the mode changes still to come are different now */
+		sched_after(SCHED_DISPLAY, 0);
 	}
 
 	write_io(HWREG_LCDC, value);
 }
 
-/* FIXME: if lots of cycles have passed, modes could be skipped! (is this still true?) */
+/* scheduler callback: catch up to now, then wait for the next mode change */
+void display_event(uint64_t due) {
+	/* catch up all the way to now; the next change is counted from there */
+	(void)due;
+	display_update(sched.now - display.time);
+	display.time = sched.now;
+	sched_after(SCHED_DISPLAY, next_mode_change());
+}
+
+/* the cycles from now until display_update next has something to do */
+static unsigned int next_mode_change(void) {
+	/* vblank lines only change at their end */
+	if ((read_io(HWREG_LCDC) & 0x80) && read_io(HWREG_LY) >= DISPLAY_H)
+		return HBLANK_CYCLES - display.cycles;
+	if (display.cycles < OAM_CYCLES)
+		return OAM_CYCLES - display.cycles;
+	if (display.cycles < OAM_VRAM_CYCLES)
+		return OAM_VRAM_CYCLES - display.cycles;
+	return HBLANK_CYCLES - display.cycles;
+}
+
+/* the first cycle at which the display could raise one of the interrupts
+ * in ie, or reaches vblank. Mode changes before then can be caught up on
+ * later, all at once (see sched_run) */
+uint64_t display_next_interrupt(Byte ie) {
+	Byte ly = read_io(HWREG_LY);
+	Byte lyc = read_io(HWREG_LYC);
+	Byte stat = read_io(HWREG_STAT);
+	uint64_t line = display.time - display.cycles;	/* start of line ly */
+	uint64_t when = SCHED_NEVER;
+
+	if (ie & INT_STAT) {
+		if (stat & (STAT_INT_OAM | STAT_INT_HBLANK | STAT_INT_VBLANK))
+			return sched.when[SCHED_DISPLAY];
+		/* ly only moves on while the lcd is on */
+		if ((stat & STAT_INT_COINCIDENCE) && (read_io(HWREG_LCDC) & 0x80)
+				&& lyc < 154) {
+			if (lyc > ly)
+				when = line + (lyc - ly) * HBLANK_CYCLES;
+			else
+				when = line + (154 - ly + lyc) * HBLANK_CYCLES;
+		}
+	}
+	/* vblank counts whether it is enabled or not: the frame is finished
+	 * there and the run stops, while catching up past line 154 would
+	 * clear the frame before anyone saw it */
+	if (read_io(HWREG_LCDC) & 0x80) {
+		if (ly < DISPLAY_H)
+			line += (DISPLAY_H - ly) * HBLANK_CYCLES;
+		else
+			line += (154 - ly + DISPLAY_H) * HBLANK_CYCLES;
+		if (line < when)
+			when = line;
+	}
+	return when;
+}
+
 void display_update(unsigned int cycles) {
+	unsigned int next;
+
+	/* split runs that could span more than one mode change (the shortest
+	 * mode is OAM_CYCLES) at each change, so none is skipped */
+	while (cycles >= (next = next_mode_change()) + OAM_CYCLES) {
+		display_step(next);
+		cycles -= next;
+	}
+	display_step(cycles);
+}
+
+static void display_step(unsigned int cycles) {
 	Byte ly, stat, lcdc, hdma_length;
 	int i;
 	display.cycles += cycles;
@@ -293,27 +360,15 @@ void display_update(unsigned int cycles) {
 				if (stat & STAT_INT_HBLANK) {
 					raise_int(INT_STAT);
 				}
-				/* draw the line */
-				if (console_mode == MODE_GBC_ENABLED) {
-					if (lcdc & 0x01)
-						draw_gbc_background(lcdc, ly);
-					else
-						clear_scan_line();
-					if (lcdc & 0x20)
-						draw_gbc_window(lcdc, ly);
-					if (lcdc & 0x02)
-						draw_gbc_sprites(lcdc, ly);
-				} else {
-					if (lcdc & 0x01)
-						draw_background(lcdc, ly);
-					else
-						clear_scan_line();
-					if (lcdc & 0x20)
-						draw_window(lcdc, ly);
-					if (lcdc & 0x02)
-						draw_sprites(lcdc, ly);
+				/* the line is drawn later, see display_flush(). Nothing is
+				 * drawn while skipping, see display_skip() */
+				if (!display.is_skipping) {
+					if (display.due_end != ly)
+						display_flush();
+					if (display.due_end == display.due_start)
+						display.due_start = ly;
+					display.due_end = ly + 1;
 				}
-				draw_scan_line(ly);
 			}
 		/* has the lcd finished hblank? */
 		} else {
@@ -347,6 +402,20 @@ void display_update(unsigned int cycles) {
 				raise_int(INT_STAT);
 			}
 			raise_int(INT_VBLANK);
+			/* draw the lines put off, all at once if none were drawn */
+			if (display.due_start == 0 && display.due_end == DISPLAY_H) {
+				draw_frame(lcdc);
+				display.due_end = 0;
+			} else {
+				display_flush();
+			}
+			/* the frame is complete until the next one starts at line 0 */
+			++display.frames;
+			/* only a frame drawn in colour is in display.frame to hash */
+			if (display.hashes != NULL && !display.is_skipping &&
+			    display.draw_mode == DRAW_RGB)
+				framelog_add(display.hashes, display.frame);
+			sched_stop();
 		}
 		if (display.cycles >= HBLANK_CYCLES) {
 			++ly;
@@ -356,8 +425,7 @@ void display_update(unsigned int cycles) {
 			if (ly == 154) {
 				ly = 0;
 				stat = check_coincidence(ly, stat);
-				draw_frame();
-				SDL_FillRect(display.display, NULL, SDL_MapRGB(display.display->format, 0xff, 0xff, 0xff));
+				clear_frame();
 				//new_frame();
 				if (lcdc & 0x04)
 					display.sprite_height = 16;
@@ -385,25 +453,65 @@ Byte check_coincidence(Byte ly, Byte stat) {
 	return stat;
 }
 
-static void draw_scan_line(Byte ly) {
-	int i;
-	Byte code;
-	for (i = 0; i < DISPLAY_W; i++) {
-		code = display.scan_line[i];
-		if (code & 0x20)
-			put_pixel(display.display, i, ly, display.spr_pal[(code >> 2) & 0x07].colour[code & 0x03]);
+/* draw lines put off in display_step, as they were when the lcd reached
+ * them: it is called before anything they read changes */
+void display_flush(void) {
+	unsigned int ly;
+	Byte lcdc = read_io(HWREG_LCDC);
+	for (ly = display.due_start; ly < display.due_end; ly++)
+		draw_line(lcdc, ly);
+	display.due_start = display.due_end = 0;
+}
+
+static void draw_line(const Byte lcdc, const Byte ly) {
+	if (console_mode == MODE_GBC_ENABLED) {
+		if (lcdc & 0x01)
+			draw_gbc_background(lcdc, ly);
 		else
-			put_pixel(display.display, i, ly, display.bg_pal[(code >> 2) & 0x07].colour[code & 0x03]);
+			clear_scan_line();
+		if (lcdc & 0x20)
+			draw_gbc_window(lcdc, ly);
+		if (lcdc & 0x02)
+			draw_gbc_sprites(lcdc, ly);
+	} else {
+		if (lcdc & 0x01)
+			draw_background(lcdc, ly);
+		else
+			clear_scan_line();
+		if (lcdc & 0x20)
+			draw_window(lcdc, ly);
+		if (lcdc & 0x02)
+			draw_sprites(lcdc, ly);
 	}
+	draw_scan_line(ly);
 }
 
-static void clear_scan_line() {
-	memset(display.scan_line, 0x00, DISPLAY_W);
+/* turn the codes in display.scan_line into the pixels of line ly. A code's
+ * low six bits index the palette table, so this is a lookup a pixel */
+void draw_scan_line(Byte ly) {
+	const Byte *code = display.scan_line;
+	Colour *row = display.frame + (ly * DISPLAY_W);
+	Byte *shades = display.shades + (ly * DISPLAY_W);
+	int i;
+	if (display.draw_mode == DRAW_SHADES) {
+		for (i = 0; i < DISPLAY_W; i += 4) {
+			shades[i] = display.pal_shade[code[i] & 0x3F];
+			shades[i + 1] = display.pal_shade[code[i + 1] & 0x3F];
+			shades[i + 2] = display.pal_shade[code[i + 2] & 0x3F];
+			shades[i + 3] = display.pal_shade[code[i + 3] & 0x3F];
+		}
+		return;
+	}
+	for (i = 0; i < DISPLAY_W; i += 4) {
+		row[i] = display.pal_colour[code[i] & 0x3F];
+		row[i + 1] = display.pal_colour[code[i + 1] & 0x3F];
+		row[i + 2] = display.pal_colour[code[i + 2] & 0x3F];
+		row[i + 3] = display.pal_colour[code[i + 3] & 0x3F];
+	}
 }
 
-void draw_frame() {
-	scale_nn4x(display.display, display.screen);
-	SDL_Flip(display.screen);
+static void clear_scan_line() {
+	memset(display.scan_line, 0x00, DISPLAY_W);
 }
 
 static void draw_background(const Byte lcdc, const Byte ly) {
@@ -578,59 +686,175 @@ static void draw_gbc_window(const Byte lcdc, const Byte ly) {
 	}
 }
 
-/* TODO optimise? */
+/* a tile of a row of the background or window, see draw_frame() */
+typedef struct {
+	Tile *t;
+	Byte flip;
+	Byte pal;
+} RowTile;
+
+/* look up n tiles of the tile map at map from tile_x on, wrapping round,
+ * as draw_background() and the others do. flips masks the flips gbc tiles
+ * may have */
+static void fetch_row(RowTile *row, const int n, const Word map, const Byte tile_x, const Byte lcdc, const Byte flips) {
+	unsigned int tile_code;
+	Byte attrib = 0;
+	int k;
+	for (k = 0; k < n; k++) {
+		tile_code = display.vram[map - MEM_VIDEO + ((tile_x + k) & 31)];
+		if (console_mode == MODE_GBC_ENABLED)
+			attrib = display.vram[map - MEM_VIDEO + VRAM_BANK_SIZE + ((tile_x + k) & 31)];
+		if (attrib & TILE_VRAM_BANK)
+			tile_code += 256;
+		if ((lcdc & 0x10) == 0) {
+			// tile data is at 0x8800-0x97FF (indeces signed)
+			row[k].t = &display.tiles_tdt_1[tile_code ^ 0x80];
+		} else {
+			row[k].t = &display.tiles_tdt_0[tile_code];
+		}
+		row[k].flip = (attrib >> 5) & flips;
+		row[k].pal = attrib & 0x07;
+	}
+}
+
+/* tile_blit(), a whole row of eight pixels at once where it can */
+static inline void row_blit(const RowTile *rt, const int x, const int line) {
+	uint64_t px;
+	if (x < 0 || x > DISPLAY_W - 8) {
+		tile_blit(rt->t, x, line, rt->flip, rt->pal, PRIORITY_LOW);
+		return;
+	}
+	if (rt->t->is_dirty & (1 << rt->flip))
+		tile_regenerate(rt->t, rt->flip);
+	memcpy(&px, rt->t->cache_px + (rt->flip * TILE_PX) + (line * 8), 8);
+	px |= (rt->pal << 2) * 0x0101010101010101ULL;
+	memcpy(display.scan_line + x, &px, 8);
+}
+
+/* draw a whole frame that nothing changed during, the same as draw_line()
+ * for each line would, but looking up each row of tiles only once for
+ * the eight lines it covers */
+static void draw_frame(const Byte lcdc) {
+	RowTile bg[21], win[32];
+	Byte scx = read_io(HWREG_SCX);
+	Byte scy = read_io(HWREG_SCY);
+	Byte wx = read_io(HWREG_WX);
+	Byte wy = read_io(HWREG_WY);
+	Word bg_map = (lcdc & 0x08) ? TILE_MAP_1 : TILE_MAP_0;
+	Word win_map = (lcdc & 0x40) ? TILE_MAP_1 : TILE_MAP_0;
+	Byte bg_y, win_y;
+	int ly, k, x;
+	for (ly = 0; ly < DISPLAY_H; ly++) {
+		bg_y = ly + scy;
+		if (lcdc & 0x01) {
+			if (ly == 0 || (bg_y & 0x07) == 0)
+				fetch_row(bg, 21, bg_map + ((bg_y / 8) * 32), scx / 8, lcdc, 0x03);
+			for (k = 0; k < 21; k++) {
+				x = (k * 8) - (scx & 0x07);
+				/* dont draw over the window! */
+				if ((lcdc & 0x20) && (x + 7 >= wx) && (ly >= wy))
+					continue;
+				row_blit(&bg[k], x, bg_y & 0x07);
+			}
+		} else {
+			clear_scan_line();
+		}
+		if ((lcdc & 0x20) && (ly >= wy)) {
+			win_y = ly - wy;
+			/* window tiles are drawn unflipped, as in draw_gbc_window() */
+			if (ly == wy || (win_y & 0x07) == 0)
+				fetch_row(win, 32, win_map + ((win_y / 8) * 32), 0, lcdc, 0);
+			for (k = 0; k < 32; k++) {
+				x = (k * 8) + wx - 7;
+				if (x >= DISPLAY_W)
+					break;
+				row_blit(&win[k], x, win_y & 0x07);
+			}
+		}
+		if (lcdc & 0x02) {
+			if (console_mode == MODE_GBC_ENABLED)
+				draw_gbc_sprites(lcdc, ly);
+			else
+				draw_sprites(lcdc, ly);
+		}
+		draw_scan_line(ly);
+	}
+}
+
+/* fill in display.sprite_lines from oam. Like the lcd, this takes the
+ * first MAX_SPRITES_PER_LINE entries in oam that cover a line, wherever
+ * they are across it */
+static void find_sprite_lines(void) {
+	int i, line, top, bottom;
+
+	memset(display.sprite_line_count, 0, sizeof(display.sprite_line_count));
+	for (i = 0; i < OAM_BLOCKS; i++) {
+		top = get_sprite_y(i) - 16;
+		bottom = top + display.sprite_height;
+		if (top < 0)
+			top = 0;
+		if (bottom > DISPLAY_H)
+			bottom = DISPLAY_H;
+		for (line = top; line < bottom; line++) {
+			if (display.sprite_line_count[line] < MAX_SPRITES_PER_LINE)
+				display.sprite_lines[line][display.sprite_line_count[line]++] = i;
+		}
+	}
+	display.sprite_lines_height = display.sprite_height;
+	display.is_sprite_lines_due = 0;
+}
+
+/* sprites earlier in oam are drawn over later ones, so the line's sprites
+ * are drawn last first */
 static void draw_sprites(const Byte lcdc, const Byte ly) {
-	int sprite_x;
 	int sprite_y;
-	int offset_y;
-	int i;
-	Byte priority;
-	for (i = OAM_BLOCKS - 1; i >= 0; i--) {
+	int i, n;
+	Byte flags;
+	if (display.is_sprite_lines_due || display.sprite_lines_height != display.sprite_height)
+		find_sprite_lines();
+	for (n = display.sprite_line_count[ly] - 1; n >= 0; n--) {
+		i = display.sprite_lines[ly][n];
 		sprite_y = get_sprite_y(i) - (signed)16;
-		sprite_x = get_sprite_x(i) - (signed)8;
-		priority = get_sprite_flags(i) >> 7;
-		if ((ly >= sprite_y) && (ly < (sprite_y + display.sprite_height))) {
-			offset_y = (signed)ly - sprite_y;
-			sprite_blit(&display.tiles_tdt_0[get_sprite_pattern(i)], sprite_x, offset_y, (get_sprite_flags(i) & 0x60) >> 5, (get_sprite_flags(i) >> 4) & 0x01, priority, display.sprite_height);
-		}
+		flags = get_sprite_flags(i);
+		sprite_blit(&display.tiles_tdt_0[get_sprite_pattern(i)], get_sprite_x(i) - (signed)8, (signed)ly - sprite_y, (flags & 0x60) >> 5, (flags >> 4) & 0x01, flags >> 7, display.sprite_height);
 	}
 }
 
 static void draw_gbc_sprites(const Byte lcdc, const Byte ly) {
-	int sprite_x;
 	int sprite_y;
-	int offset_y;
-	int i;
-	Byte priority;
+	int i, n;
+	Byte flags;
 	int tile_code;
-	for (i = OAM_BLOCKS - 1; i >= 0; i--) {
+	if (display.is_sprite_lines_due || display.sprite_lines_height != display.sprite_height)
+		find_sprite_lines();
+	for (n = display.sprite_line_count[ly] - 1; n >= 0; n--) {
+		i = display.sprite_lines[ly][n];
 		sprite_y = get_sprite_y(i) - (signed)16;
-		sprite_x = get_sprite_x(i) - (signed)8;
-		priority = get_sprite_flags(i) >> 7;
-		if ((ly >= sprite_y) && (ly < (sprite_y + display.sprite_height))) {
-			offset_y = (signed)ly - sprite_y;
-			tile_code = get_sprite_pattern(i);
-			if (get_sprite_flags(i) & 0x08)
-				tile_code += 256;
-			sprite_blit(&display.tiles_tdt_0[tile_code], sprite_x, offset_y, (get_sprite_flags(i) & 0x60) >> 5, get_sprite_flags(i) & 0x07, priority, display.sprite_height);
-		}
+		flags = get_sprite_flags(i);
+		tile_code = get_sprite_pattern(i);
+		if (flags & 0x08)
+			tile_code += 256;
+		sprite_blit(&display.tiles_tdt_0[tile_code], get_sprite_x(i) - (signed)8, (signed)ly - sprite_y, (flags & 0x60) >> 5, flags & 0x07, flags >> 7, display.sprite_height);
 	}
 }
 
 
+/* the four colours of a dmg palette register p, from pal_colour[first] */
+static void set_mono_palette(unsigned int first, Byte p) {
+	int i;
+	for (i = 0; i < 4; i++) {
+		display.pal_colour[first + i] = display.mono_colours[(p >> (i * 2)) & 0x03];
+		display.pal_shade[first + i] = (p >> (i * 2)) & 0x03;
+	}
+}
+
 void update_bg_palette(unsigned n, Byte p) {
-	display.bg_pal[n].colour[0] = display.mono_colours[p & 0x03];
-	display.bg_pal[n].colour[1] = display.mono_colours[(p >> 2) & 0x03];
-	display.bg_pal[n].colour[2] = display.mono_colours[(p >> 4) & 0x03];
-	display.bg_pal[n].colour[3] = display.mono_colours[(p >> 6) & 0x03];
+	set_mono_palette(n * 4, p);
 }
 
 void update_sprite_palette(unsigned n, Byte p) {
 	// colour 0 is transparent anyway.
-	display.spr_pal[n].colour[0] = display.mono_colours[p & 0x03];
-	display.spr_pal[n].colour[1] = display.mono_colours[(p >> 2) & 0x03];
-	display.spr_pal[n].colour[2] = display.mono_colours[(p >> 4) & 0x03];
-	display.spr_pal[n].colour[3] = display.mono_colours[(p >> 6) & 0x03];
+	set_mono_palette(PAL_SPRITE + (n * 4), p);
 }
 
 void update_gbc_bg_palette(Byte value) {
@@ -638,6 +862,7 @@ void update_gbc_bg_palette(Byte value) {
 	int pal, col, byte1, byte2;
 	Byte r, g, b;
 	
+	display_changing();
 	bgpi = read_io(HWREG_BGPI);
 	index = bgpi & 0x3f;
 	pal = index / 8;
@@ -650,7 +875,8 @@ void update_gbc_bg_palette(Byte value) {
 	r = byte1 & 0x1f;
 	g = ((byte1 >> 5) & 0x07) | ((byte2 & 0x03) << 3);
 	b = (byte2 >> 2) & 0x1f;
-	display.bg_pal[pal].colour[col] = translate_gbc_rgb(r, g, b);
+	display.pal_colour[(pal * 4) + col] = translate_gbc_rgb(r, g, b);
+	display.pal_shade[(pal * 4) + col] = gbc_shade(r, g, b);
 	
 	/* autoincrement? */
 	if (bgpi & 0x80)
@@ -662,6 +888,7 @@ void update_gbc_spr_palette(Byte value) {
 	int pal, col, byte1, byte2;
 	Byte r, g, b;
 	
+	display_changing();
 	obpi = read_io(HWREG_OBPI);
 	index = obpi & 0x3f;
 	pal = index / 8;
@@ -674,7 +901,8 @@ void update_gbc_spr_palette(Byte value) {
 	r = byte1 & 0x1f;
 	g = ((byte1 >> 5) & 0x07) | ((byte2 & 0x03) << 3);
 	b = (byte2 >> 2) & 0x1f;
-	display.spr_pal[pal].colour[col] = translate_gbc_rgb(r, g, b);
+	display.pal_colour[PAL_SPRITE + (pal * 4) + col] = translate_gbc_rgb(r, g, b);
+	display.pal_shade[PAL_SPRITE + (pal * 4) + col] = gbc_shade(r, g, b);
 	
 	/* autoincrement? */
 	if (obpi & 0x80)
@@ -686,6 +914,12 @@ static Colour translate_gbc_rgb(uint8_t r, uint8_t g, uint8_t b) {
 	return map_rgb(r * 8, g * 8, b * 8);
 }
 
+/* the nearest dmg shade to a colour, by its brightness */
+static Byte gbc_shade(uint8_t r, uint8_t g, uint8_t b) {
+	unsigned int y = (r * 2 + g * 4 + b) / 7;	/* 0 to 31 */
+	return 3 - (y >> 3);
+}
+
 static inline Byte get_sprite_x(const unsigned int sprite) {
 	return display.oam[(OAM_BLOCK_SIZE * sprite) + OAM_XPOS];
 }
@@ -708,9 +942,11 @@ static inline Byte get_sprite_flags(const unsigned int sprite) {
 void launch_dma(Byte address) {
 	unsigned int i;
 	Word real_address = address * 0x100;
+	display_changing();
 	for (i = 0; i < SIZE_OAM; i++) {
 		display.oam[i] = readb(real_address + i);
 	}
+	display.is_sprite_lines_due = 1;
 }
 
 static void launch_hdma(int length) {
@@ -754,74 +990,21 @@ void start_hdma(Byte hdma5) {
 	}
 }
 
-// gets colour of a pixel
-static inline Uint32 get_pixel(const SDL_Surface *surface, const int x, 
-			const int y) {
-	//assert (surface != NULL);
-	//assert (x < surface->w); assert (x >= 0);
-	//assert (y < surface->h); assert (y >= 0);
-	unsigned int bpp = surface->format->BytesPerPixel;
-	Uint8 *p = (Uint8 *)surface->pixels + y * surface->pitch + x * bpp;
-	switch (bpp) {
-		case 1:
-			return *p;
-		case 2:
-			return *(Uint16*)p;
-		case 3:
-			if(SDL_BYTEORDER == SDL_BIG_ENDIAN) {
-				return p[0] << 16 | p[1] << 8 | p[2];
-			} else {
-				return p[0] | p[1] << 8 | p[2] << 16;
-			}
-		case 4:
-			return *(Uint32*)p;
-		default:
-			return 0; // shouldn't happen, but avoids warnings
-	}
-}
-
-
-
-// sets colour of a pixel
-
-static inline void put_pixel(const SDL_Surface *surface, const int x, const int y, 
-                        const Uint32 pixel) {
-	Uint8 *p = (Uint8*)surface->pixels + y * surface->pitch + x * 4;
-	*(Uint32 *)p = pixel;
-
-}
-#if 0
-static inline void put_pixel(const SDL_Surface *surface, const int x, const int y, 
-                        const Uint32 pixel) {
-	//assert (surface != NULL);
-	assert (x < surface->w); assert (x >= 0);
-	assert (y < surface->h); assert (y >= 0);
-	unsigned int bpp = surface->format->BytesPerPixel;
-	Uint8 *p = (Uint8*)surface->pixels + y * surface->pitch + x * bpp;
-	switch (bpp) {
-		case 1:
-			*p = pixel;
-			break;
- 		case 2:
-			*(Uint16*)p = pixel;
-			break;
-		case 3:
-			if(SDL_BYTEORDER == SDL_BIG_ENDIAN) {
-				p[0] = (pixel >> 16) & 0xff;
-				p[1] = (pixel >> 8) & 0xff;
-				p[2] = pixel & 0xff;
-			} else {
-				p[0] = pixel & 0xff;
-				p[1] = (pixel >> 8) & 0xff;
-				p[2] = (pixel >> 16) & 0xff;
-			}
-			break;
-		case 4:
-			*(Uint32 *)p = pixel;
-			break;
+/* blank the lcd, to white */
+static void clear_frame(void) {
+	int i;
+	if (display.is_skipping) {
+		display.is_clear_due = 1;
+		return;
+	}
+	display.is_clear_due = 0;
+	if (display.draw_mode == DRAW_SHADES) {
+		memset(display.shades, 0, sizeof(display.shades));
+		return;
 	}
+	for (i = 0; i < DISPLAY_W * DISPLAY_H; i++)
+		display.frame[i] = map_rgb(0xff, 0xff, 0xff);
 }
-#endif
 
 static inline Colour map_rgb(uint8_t r, uint8_t g, uint8_t b) {
 #if WORDS_BIGENDIAN
@@ -831,66 +1014,57 @@ static inline Colour map_rgb(uint8_t r, uint8_t g, uint8_t b) {
 #endif
 }
 
-static void fill_rectangle(SDL_Surface *surface, const int x, const int y, 
-                            const int w, const int h, 
-                            const unsigned int colour) {
-	SDL_Rect r;
-	assert(surface != NULL);
-	assert(w >= 0); assert(h >= 0);
-	r.x = x;
-	r.y = y;
-	r.w = w;
-	r.h = h;
-	if (SDL_FillRect(surface, &r, colour) < 0) {
-		fprintf(stderr, "warning: SDL_FillRect() failed: %s\n", SDL_GetError());
-		exit(1);
-	}
-}
-
-static void tile_init(Tile *t, Byte* vram_px, Tile *next) {
-	int i;
+static void tile_init(Tile *t, Byte* vram_px, Byte *cache_px, Tile *next) {
 	t->vram_px = vram_px;
+	t->cache_px = cache_px;
 	t->next = next;
-	for (i = 0; i < 4; i++) {
-		//t->is_dirty[i] = 1;
-		t->cache_px[i] = NULL;
-	}
+	tile_dirty(t);
 }
 
-static void tile_fini(Tile *t) {
-	int i;
-	for (i = 0; i < 4; i++) {
-		//t->is_dirty[i] = 1;
-		if (t->cache_px[i] != NULL) {
-			free(t->cache_px[i]);
-			t->cache_px[i] = NULL;
-		}
+/* a row of a tile is two bytes, the low and high bits of its eight
+ * pixels' colours. tile_row[b] spreads the bits of b out a byte a pixel,
+ * leftmost pixel first in memory, so a decoded row is
+ * tile_row[lo] | (tile_row[hi] << 1). The second table has the bits the
+ * other way round, for tiles flipped in x */
+#ifdef WORDS_BIGENDIAN
+#define ROW_BIT(b, bit, x)		((uint64_t)(((b) >> (bit)) & 1) << (8 * (7 - (x))))
+#else
+#define ROW_BIT(b, bit, x)		((uint64_t)(((b) >> (bit)) & 1) << (8 * (x)))
+#endif
+#define ROW(b)			(ROW_BIT(b, 7, 0) | ROW_BIT(b, 6, 1) | ROW_BIT(b, 5, 2) | ROW_BIT(b, 4, 3) | \
+						 ROW_BIT(b, 3, 4) | ROW_BIT(b, 2, 5) | ROW_BIT(b, 1, 6) | ROW_BIT(b, 0, 7))
+#define ROW_FLIPPED(b)	(ROW_BIT(b, 0, 0) | ROW_BIT(b, 1, 1) | ROW_BIT(b, 2, 2) | ROW_BIT(b, 3, 3) | \
+						 ROW_BIT(b, 4, 4) | ROW_BIT(b, 5, 5) | ROW_BIT(b, 6, 6) | ROW_BIT(b, 7, 7))
+#define ROWS_4(r, b)	r(b), r(b + 1), r(b + 2), r(b + 3)
+#define ROWS_16(r, b)	ROWS_4(r, b), ROWS_4(r, b + 4), ROWS_4(r, b + 8), ROWS_4(r, b + 12)
+#define ROWS_64(r, b)	ROWS_16(r, b), ROWS_16(r, b + 16), ROWS_16(r, b + 32), ROWS_16(r, b + 48)
+#define ROWS_256(r)		ROWS_64(r, 0), ROWS_64(r, 64), ROWS_64(r, 128), ROWS_64(r, 192)
+
+static const uint64_t tile_row[2][256] = {
+	{ROWS_256(ROW)},
+	{ROWS_256(ROW_FLIPPED)}
+};
+
+void tile_decode(Byte *px, const Byte *vram_px, const int flip) {
+	const uint64_t *row = tile_row[(flip & X_FLIP) != 0];
+	uint64_t colours;
+	int y, step = 8;
+
+	if (flip & Y_FLIP) {
+		px += 7 * 8;
+		step = -8;
+	}
+	for (y = 0; y < 8; y++) {
+		colours = row[vram_px[y * 2]] | (row[vram_px[(y * 2) + 1]] << 1);
+		memcpy(px, &colours, 8);
+		px += step;
 	}
 }
 
 static void tile_regenerate(Tile *t, const int flip) {
-	int x, y;
-	Byte colour;
-	Byte cache_x;
-	Byte cache_y;
-	//fill_rectangle(sprite->surface[flip], 0, 0, 8, sprite->height, 0);
-	assert(t->cache_px[flip] == NULL);
-	t->cache_px[flip] = malloc(8 * 8 * sizeof(Byte));
-	for (y = 0; y < 8; y++) {
-		for (x = 0; x < 8; x++) {
-			colour  = (t->vram_px[y * 2] & (0x80  >> x)) >> (7 - x);
-			colour |= (t->vram_px[(y * 2) + 1] & (0x80  >> x)) >> (7 - x) << 1;
-			cache_x = x;
-			cache_y = y;
-			if (flip & X_FLIP)
-				cache_x = 7 - cache_x;
-			if (flip & Y_FLIP)
-				cache_y = (8 - 1) - cache_y;
-		  //put_pixel(sprite->surface[flip], cache_x, cache_y, colour_code);
-			t->cache_px[flip][cache_y * 8 + cache_x] = colour;
-		}
-	}
-	//sprite->is_invalidated[flip] = 0;
+	assert(t->is_dirty & (1 << flip));
+	tile_decode(t->cache_px + (flip * TILE_PX), t->vram_px, flip);
+	t->is_dirty &= ~(1 << flip);
 }
 
 static void tile_blit(Tile *t, const int x, const int line, const int flip, const int pal, const int priority) {
@@ -908,13 +1082,13 @@ static void tile_blit(Tile *t, const int x, const int line, const int flip, cons
 		w = 8 - (x + w - DISPLAY_W);
 	}
 
-	if (t->cache_px[flip] == NULL)
+	if (t->is_dirty & (1 << flip))
 		tile_regenerate(t, flip);
 
 	data = 0 | (pal << 2) | (priority << 6);
 
 	for (; i < w; i++) {
-		colour_code = t->cache_px[flip][line * 8 + i];
+		colour_code = t->cache_px[flip * TILE_PX + line * 8 + i];
 		//if ((line * 8 + i) > 63) {
 		//	fprintf(stderr, "%i, line = %i, i = %i, x = %i\n", (line * 8 + i), line, i, x);
 		//}
@@ -954,13 +1128,13 @@ static void sprite_blit(Tile *t, const int x, int line, const int flip, const in
 		w = 8 - (x + w - DISPLAY_W);
 	}
 
-	if (t->cache_px[flip] == NULL)
+	if (t->is_dirty & (1 << flip))
 		tile_regenerate(t, flip);
 
 	data = 0 | (pal << 2) | 0x20;
 
 	for (; i < w; i++) {
-		colour_code = t->cache_px[flip][line * 8 + i];
+		colour_code = t->cache_px[flip * TILE_PX + line * 8 + i];
 		current_px = display.scan_line[x + i];
 		if (current_px & 0x40)
 			continue;
@@ -1004,6 +1178,7 @@ void display_load(void) {
 	display.vram_bank = load_uint("vram_bank");
 	set_vector_block(MEM_VIDEO, display.vram + (display.vram_bank * 0x2000), SIZE_VIDEO);
 	load_memory("oam", display.oam, SIZE_OAM);
+	display.is_sprite_lines_due = 1;
 	
 	display.is_hdma_active = load_uint("dma");
 	
@@ -28,8 +28,9 @@
 #define _DISPLAY_H
 
 #include <stdint.h>
-#include <SDL/SDL.h>
+#include <stdlib.h>
 //#include "config.h"
+#include "framehash.h"
 
 #define DISPLAY_W 				160
 #define	DISPLAY_H				144
@@ -95,46 +96,77 @@
 
 #define VRAM_BANK_SIZE			0x2000
 
-#define GB_FRAME_PERIOD ((HBLANK_CYCLES * 154 * 1000) / 4194304)
+#define GB_FRAME_CYCLES			(HBLANK_CYCLES * 154)
+#define GB_FRAME_PERIOD ((GB_FRAME_CYCLES * 1000) / 4194304)
 
 //struct tile;
 //struct tprite;
 
-typedef Uint32 Colour;
+typedef uint32_t Colour;		/* 0x00RRGGBB */
 
-typedef struct palette {
-	Colour colour[4];
-} Palette;
+/* the palettes are kept as one table of colours, indexed by the low six
+ * bits of a scan line code: four colours each of the eight background
+ * palettes, then of the eight sprite palettes */
+#define PAL_ENTRIES				64
+#define PAL_SPRITE				0x20		/* where the sprite palettes start */
+
+/* what the display makes of each line it draws */
+typedef enum {
+	DRAW_RGB,				/* colours, into frame */
+	DRAW_SHADES				/* shades, into shades */
+} DrawMode;
+
+#define TILE_PX					(8 * 8)		/* a byte a pixel, when decoded */
+#define TILE_FLIPS				4
 
 typedef struct tile {
 	struct tile* next;
 	Byte* vram_px;
-	Byte* cache_px[4];
+	Byte* cache_px;			/* each flip decoded, TILE_PX apart, in the arena */
+	unsigned int is_dirty;	/* a bit for each flip not decoded since vram changed */
 } Tile;
 
 
 typedef struct {
-	SDL_Surface *screen;
-	SDL_Surface *display;
+	Colour frame[DISPLAY_W * DISPLAY_H];		/* what has been drawn so far */
+	unsigned int frames;		/* frames finished, counted at the start of vblank */
+	FrameLog *hashes;			/* of each frame finished, or NULL */
+	Byte shades[DISPLAY_W * DISPLAY_H];
+	DrawMode draw_mode;
+	unsigned int is_skipping;	/* drawing nothing, see display_skip() */
+	unsigned int is_clear_due;	/* the lcd was blanked while skipping */
 	//SDL_Palette background_palette[8];
 	//SDL_Palette sprite_palette[8];
 	//SDL_Color colours[4];
-	Palette bg_pal[8];
-	Palette spr_pal[8];
+	Colour pal_colour[PAL_ENTRIES];
+	Byte pal_shade[PAL_ENTRIES];	/* 0 (white) to 3, for DRAW_SHADES */
 	Colour mono_colours[4];
 	Byte *gbc_bg_pal_mem;
 	Byte *gbc_spr_pal_mem;
 
-	unsigned int x_res, y_res, bpp;
 	unsigned int cycles;
+	uint64_t time;			/* sched.now at the last display_update */
 	Byte *vram;
 	Byte *oam;
 	//Uint32 palette_bg[4];
 	//Uint32 palette_sprite_0[4];
 	//Uint32 palette_sprite_1[4];
 	int sprite_height;
+	/* the oam entries on each line, at most MAX_SPRITES_PER_LINE of them
+	 * in oam order, as the lcd picks them. Worked out again only after
+	 * oam or the sprite height changes */
+	Byte sprite_lines[DISPLAY_H][MAX_SPRITES_PER_LINE];
+	Byte sprite_line_count[DISPLAY_H];
+	int sprite_lines_height;	/* the sprite height they were worked out for */
+	unsigned int is_sprite_lines_due;
+	/* lines the lcd has reached this frame but that aren't drawn yet, from
+	 * due_start up to due_end. They are put off in case nothing they read
+	 * changes before vblank, when the whole frame can be drawn at once */
+	unsigned int due_start;
+	unsigned int due_end;
 	struct tile* tiles_tdt_0;
 	struct tile* tiles_tdt_1;
+	Byte *tile_arena;		/* the decoded tiles of both tables */
 	Byte* scan_line;
 	//struct sprite* sprites;
 	unsigned int vram_bank;
@@ -142,6 +174,10 @@ typedef struct {
 	unsigned int cache_size;
 } Display;
 
+/* the lcd of the selected instance, see instance.h */
+extern __thread Display *gb_display;
+#define display		(*gb_display)
+
 
 #if 0
 typedef struct tile {
@@ -161,10 +197,15 @@ typedef struct sprite {
 
 
 void display_update(unsigned int cycles);
+void display_event(uint64_t due);
+uint64_t display_next_interrupt(Byte ie);
 void display_reset(void);
 void display_init(void);
 void display_fini(void);
-void draw_frame(void);
+void display_skip(unsigned int is_skipping);
+void tile_decode(Byte *px, const Byte *vram_px, const int flip);
+void draw_scan_line(Byte ly);
+void display_flush(void);
 void update_bg_palette(unsigned n, Byte p);
 void update_sprite_palette(unsigned n, Byte p);
 Byte check_coincidence(Byte ly, Byte stat);
@@ -177,6 +218,7 @@ void set_lcdc(Byte value);
 void update_gbc_bg_palette(Byte value);
 void update_gbc_spr_palette(Byte value);
 
+static inline void display_changing(void);
 static inline void write_vram(const Word address, const Byte value);
 static inline Byte read_vram(const Word address);
 static inline void write_oam(const Word address, const Byte value);
@@ -185,8 +227,16 @@ static void tile_dirty(Tile *t);
 //static inline void sprite_invalidate(Sprite *sprite);
 
 
+/* call before changing anything drawing a line reads, so the lines put
+ * off so far are drawn as they were when the lcd reached them */
+static inline void display_changing(void) {
+	if (display.due_end != display.due_start)
+		display_flush();
+}
+
 static inline void write_vram(const Word address, const Byte value) {
-	extern Display display;
+	if (display.vram[address - MEM_VIDEO + (display.vram_bank * 0x2000)] != value)
+		display_changing();
 	// NO else here, tile data tables overlap!
 	if ((address >= TDT_0) && (address < (TDT_0 + TDT_0_LEN))) {
 		tile_dirty(&display.tiles_tdt_0[(display.vram_bank * 256) + ((address - TDT_0) >> 4)]);
@@ -198,17 +248,16 @@ static inline void write_vram(const Word address, const Byte value) {
 }
 
 static inline Byte read_vram(const Word address) {
-	extern Display display;
 	return display.vram[address - MEM_VIDEO + (display.vram_bank * 0x2000)];
 }
 
 static inline void write_oam(const Word address, const Byte value) {
-	extern Display display;
-    display.vram[address - MEM_OAM] = value;
+	display_changing();
+	display.oam[address - MEM_OAM] = value;
+	display.is_sprite_lines_due = 1;
 }
 
 static inline Byte read_oam(const Word address) {
-	extern Display display;
 	return display.oam[address - MEM_OAM];
 }
 
@@ -222,13 +271,7 @@ static inline void sprite_invalidate(Sprite *sprite) {
 */
 
 static void tile_dirty(Tile *t) {
-	int i;
-	for (i = 0; i < 4; i++) {
-		if (t->cache_px[i] != NULL) {
-			free(t->cache_px[i]);
-			t->cache_px[i] = NULL;
-		}
-	}
+	t->is_dirty = (1 << TILE_FLIPS) - 1;
 }
 
 
@@ -0,0 +1,1699 @@
+/*
+ * execute.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* the instruction loop, included twice by core.c to build the two
+ * versions of execute_cycles (see there). Not a normal header: it has no
+ * include guard and expects EXECUTE, EXECUTE_DEBUG and everything else
+ * in core.c above the point where it is included. */
+
+static int EXECUTE(int max_cycles) {
+	int cycles = 0;
+	int total_cycles = 0;
+	Byte opcode = 0;
+#ifdef CORE_BLOCK_CACHE
+	const MicroOp *mop = NULL, *mop_end = NULL;
+	Word imm = 0;
+#endif
+#ifdef CORE_THREADED
+	static const void *const op_table[256] = {
+		&&op_00, &&op_01, &&op_02, &&op_03, &&op_04, &&op_05, &&op_06, &&op_07,
+		&&op_08, &&op_09, &&op_0A, &&op_0B, &&op_0C, &&op_0D, &&op_0E, &&op_0F,
+		&&op_10, &&op_11, &&op_12, &&op_13, &&op_14, &&op_15, &&op_16, &&op_17,
+		&&op_18, &&op_19, &&op_1A, &&op_1B, &&op_1C, &&op_1D, &&op_1E, &&op_1F,
+		&&op_20, &&op_21, &&op_22, &&op_23, &&op_24, &&op_25, &&op_26, &&op_27,
+		&&op_28, &&op_29, &&op_2A, &&op_2B, &&op_2C, &&op_2D, &&op_2E, &&op_2F,
+		&&op_30, &&op_31, &&op_32, &&op_33, &&op_34, &&op_35, &&op_36, &&op_37,
+		&&op_38, &&op_39, &&op_3A, &&op_3B, &&op_3C, &&op_3D, &&op_3E, &&op_3F,
+		&&op_40, &&op_41, &&op_42, &&op_43, &&op_44, &&op_45, &&op_46, &&op_47,
+		&&op_48, &&op_49, &&op_4A, &&op_4B, &&op_4C, &&op_4D, &&op_4E, &&op_4F,
+		&&op_50, &&op_51, &&op_52, &&op_53, &&op_54, &&op_55, &&op_56, &&op_57,
+		&&op_58, &&op_59, &&op_5A, &&op_5B, &&op_5C, &&op_5D, &&op_5E, &&op_5F,
+		&&op_60, &&op_61, &&op_62, &&op_63, &&op_64, &&op_65, &&op_66, &&op_67,
+		&&op_68, &&op_69, &&op_6A, &&op_6B, &&op_6C, &&op_6D, &&op_6E, &&op_6F,
+		&&op_70, &&op_71, &&op_72, &&op_73, &&op_74, &&op_75, &&op_76, &&op_77,
+		&&op_78, &&op_79, &&op_7A, &&op_7B, &&op_7C, &&op_7D, &&op_7E, &&op_7F,
+		&&op_80, &&op_81, &&op_82, &&op_83, &&op_84, &&op_85, &&op_86, &&op_87,
+		&&op_88, &&op_89, &&op_8A, &&op_8B, &&op_8C, &&op_8D, &&op_8E, &&op_8F,
+		&&op_90, &&op_91, &&op_92, &&op_93, &&op_94, &&op_95, &&op_96, &&op_97,
+		&&op_98, &&op_99, &&op_9A, &&op_9B, &&op_9C, &&op_9D, &&op_9E, &&op_9F,
+		&&op_A0, &&op_A1, &&op_A2, &&op_A3, &&op_A4, &&op_A5, &&op_A6, &&op_A7,
+		&&op_A8, &&op_A9, &&op_AA, &&op_AB, &&op_AC, &&op_AD, &&op_AE, &&op_AF,
+		&&op_B0, &&op_B1, &&op_B2, &&op_B3, &&op_B4, &&op_B5, &&op_B6, &&op_B7,
+		&&op_B8, &&op_B9, &&op_BA, &&op_BB, &&op_BC, &&op_BD, &&op_BE, &&op_BF,
+		&&op_C0, &&op_C1, &&op_C2, &&op_C3, &&op_C4, &&op_C5, &&op_C6, &&op_C7,
+		&&op_C8, &&op_C9, &&op_CA, &&op_CB, &&op_CC, &&op_CD, &&op_CE, &&op_CF,
+		&&op_D0, &&op_D1, &&op_D2, &&op_invalid, &&op_D4, &&op_D5, &&op_D6, &&op_D7,
+		&&op_D8, &&op_D9, &&op_DA, &&op_invalid, &&op_DC, &&op_invalid, &&op_DE, &&op_DF,
+		&&op_E0, &&op_E1, &&op_E2, &&op_invalid, &&op_invalid, &&op_E5, &&op_E6, &&op_E7,
+		&&op_E8, &&op_E9, &&op_EA, &&op_invalid, &&op_invalid, &&op_ED, &&op_EE, &&op_EF,
+		&&op_F0, &&op_F1, &&op_F2, &&op_F3, &&op_invalid, &&op_F5, &&op_F6, &&op_F7,
+		&&op_F8, &&op_F9, &&op_FA, &&op_FB, &&op_invalid, &&op_invalid, &&op_FE, &&op_FF
+	};
+	static const void *const cb_table[256] = {
+		&&cb_00, &&cb_01, &&cb_02, &&cb_03, &&cb_04, &&cb_05, &&cb_06, &&cb_07,
+		&&cb_08, &&cb_09, &&cb_0A, &&cb_0B, &&cb_0C, &&cb_0D, &&cb_0E, &&cb_0F,
+		&&cb_10, &&cb_11, &&cb_12, &&cb_13, &&cb_14, &&cb_15, &&cb_16, &&cb_17,
+		&&cb_18, &&cb_19, &&cb_1A, &&cb_1B, &&cb_1C, &&cb_1D, &&cb_1E, &&cb_1F,
+		&&cb_20, &&cb_21, &&cb_22, &&cb_23, &&cb_24, &&cb_25, &&cb_26, &&cb_27,
+		&&cb_28, &&cb_29, &&cb_2A, &&cb_2B, &&cb_2C, &&cb_2D, &&cb_2E, &&cb_2F,
+		&&cb_30, &&cb_31, &&cb_32, &&cb_33, &&cb_34, &&cb_35, &&cb_36, &&cb_37,
+		&&cb_38, &&cb_39, &&cb_3A, &&cb_3B, &&cb_3C, &&cb_3D, &&cb_3E, &&cb_3F,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_40, &&cb_41, &&cb_42, &&cb_43, &&cb_44, &&cb_45, &&cb_46, &&cb_47,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_80, &&cb_81, &&cb_82, &&cb_83, &&cb_84, &&cb_85, &&cb_86, &&cb_87,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7,
+		&&cb_C0, &&cb_C1, &&cb_C2, &&cb_C3, &&cb_C4, &&cb_C5, &&cb_C6, &&cb_C7
+	};
+#endif
+	while (total_cycles < max_cycles) {
+		cycles = 0;
+#ifdef CORE_BLOCK_CACHE
+		/* the next op of a running block needs none of the checks below */
+		if (mop != NULL)
+			goto op_fetch;
+#endif
+		
+		/* check for interrupts */
+		handle_interrupts();
+
+		if (core.is_halted == 1) {
+/*
+			if (core.ime == 0) {
+				core.is_halted = 0;
+			}
+*/
+			sound_cycles += max_cycles - total_cycles;
+			core.cycles += max_cycles - total_cycles;
+			return max_cycles;
+		}
+
+#if EXECUTE_DEBUG
+		++core.instructions;
+		if (profiling)
+			profile_op(REG_PC);
+		/* a breakpoint turns tracing on */
+		if (debug_break(REG_PC))
+			debugging = 1;
+		if (debugging)
+			disasm_exec(REG_PC);
+#endif
+
+		if (!(core.ei | EXECUTE_DEBUG))
+			BLOCK_ENTER();
+
+		// switch opcode
+#ifdef CORE_BLOCK_CACHE
+op_fetch:
+#endif
+		FETCH();
+		DISPATCH(opcode);
+			/* 8bit loads: imm -> reg */
+			OP(06):  /* LD B, n */
+				REG_B = IMM8;
+				cycles = 8;
+				NEXT;
+			OP(0E):  /* LD C, n */
+				REG_C = IMM8;
+				cycles = 8;
+				NEXT;
+			OP(16):  /* LD D, n */
+				REG_D = IMM8;
+				cycles = 8;
+				NEXT;
+			OP(1E):  /* LD E, n */
+				REG_E = IMM8;
+				cycles = 8;
+				NEXT;
+			OP(26):  /* LD H, n */
+				REG_H = IMM8;
+				cycles = 8;
+				NEXT;
+			OP(2E):  /* LD L, n */
+				REG_L = IMM8;
+				cycles = 8;
+				NEXT;
+			/* 8bit loads: reg -> reg */
+			OP(7F):  /* LD A, A */
+				cycles = 4;
+				NEXT;
+			OP(78):  /* LD A, B */
+				REG_A = REG_B;
+				cycles = 4;
+				NEXT;
+			OP(79):  /* LD A, C */
+				REG_A = REG_C;
+				cycles = 4;
+				NEXT;
+			OP(7A):  /* LD A, D */
+				REG_A = REG_D;
+				cycles = 4;
+				NEXT;
+			OP(7B):  /* LD A, E */
+				REG_A = REG_E;
+				cycles = 4;
+				NEXT;
+			OP(7C):  /* LD A, H */
+				REG_A = REG_H;
+				cycles = 4;
+				NEXT;
+			OP(7D):  /* LD A, L */
+				REG_A = REG_L;
+				cycles = 4;
+				NEXT;
+			OP(7E):  /* LD A, (HL) */
+				REG_A = readb(REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(40):  /* LD B, B */
+				cycles = 4;
+				NEXT;
+			OP(41):  /* LD B, C */
+				REG_B = REG_C;
+				cycles = 4;
+				NEXT;
+			OP(42):  /* LD B, D */
+				REG_B = REG_D;
+				cycles = 4;
+				NEXT;
+			OP(43):  /* LD B, E */
+				REG_B = REG_E;
+				cycles = 4;
+				NEXT;
+			OP(44):  /* LD B, H */
+				REG_B = REG_H;
+				cycles = 4;
+				NEXT;
+			OP(45):  /* LD B, L */
+				REG_B = REG_L;
+				cycles = 4;
+				NEXT;
+			OP(46):  /* LD B, (HL) */
+				REG_B = readb(REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(48):  /* LD C, B */
+				REG_C = REG_B;
+				cycles = 4;
+				NEXT;
+			OP(49):  /* LD C, C */
+				cycles = 4;
+				NEXT;
+			OP(4A):  /* LD C, D */
+				REG_C = REG_D;
+				cycles = 4;
+				NEXT;
+			OP(4B):  /* LD C, E */
+				REG_C = REG_E;
+				cycles = 4;
+				NEXT;
+			OP(4C):  /* LD C, H */
+				REG_C = REG_H;
+				cycles = 4;
+				NEXT;
+			OP(4D):  /* LD C, L */
+				REG_C = REG_L;
+				cycles = 4;
+				NEXT;
+			OP(4E):  /* LD C, (HL) */
+				REG_C = readb(REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(50):  /* LD D, B */
+				REG_D = REG_B;
+				cycles = 4;
+				NEXT;
+			OP(51):  /* LD D, C */
+				REG_D = REG_C;
+				cycles = 4;
+				NEXT;
+			OP(52):  /* LD D, D */
+				cycles = 4;
+				NEXT;
+			OP(53):  /* LD D, E */
+				REG_D = REG_E;
+				cycles = 4;
+				NEXT;
+			OP(54):  /* LD D, H */
+				REG_D = REG_H;
+				cycles = 4;
+				NEXT;
+			OP(55):  /* LD D, L */
+				REG_D = REG_L;
+				cycles = 4;
+				NEXT;
+			OP(56):  /* LD D, (HL) */
+				REG_D = readb(REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(58):  /* LD E, B */
+				REG_E = REG_B;
+				cycles = 4;
+				NEXT;
+			OP(59):  /* LD E, C */
+				REG_E = REG_C;
+				cycles = 4;
+				NEXT;
+			OP(5A):  /* LD E, D */
+				REG_E = REG_D;
+				cycles = 4;
+				NEXT;
+			OP(5B):  /* LD E, E */
+				cycles = 4;
+				NEXT;
+			OP(5C):  /* LD E, H */
+				REG_E = REG_H;
+				cycles = 4;
+				NEXT;
+			OP(5D):  /* LD E, L */
+				REG_E = REG_L;
+				cycles = 4;
+				NEXT;
+			OP(5E):  /* LD E, (HL) */
+				REG_E = readb(REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(60):  /* LD H, B */
+				REG_H = REG_B;
+				cycles = 4;
+				NEXT;
+			OP(61):  /* LD H, C */
+				REG_H = REG_C;
+				cycles = 4;
+				NEXT;
+			OP(62):  /* LD H, D */
+				REG_H = REG_D;
+				cycles = 4;
+				NEXT;
+			OP(63):  /* LD H, E */
+				REG_H = REG_E;
+				cycles = 4;
+				NEXT;
+			OP(64):  /* LD H, H */
+				cycles = 4;
+				NEXT;
+			OP(65):  /* LD H, L */
+				REG_H = REG_L;
+				cycles = 4;
+				NEXT;
+			OP(66):  /* LD H, (HL) */
+				REG_H = readb(REG_HL);
+				cycles = 8;
+				NEXT;			
+			OP(68):  /* LD L, B */
+				REG_L = REG_B;
+				cycles = 4;
+				NEXT;
+			OP(69):  /* LD L, C */
+				REG_L = REG_C;
+				cycles = 4;
+				NEXT;
+			OP(6A):  /* LD L, D */
+				REG_L = REG_D;
+				cycles = 4;
+				NEXT;
+			OP(6B):  /* LD L, E */
+				REG_L = REG_E;
+				cycles = 4;
+				NEXT;
+			OP(6C):  /* LD L, H */
+				REG_L = REG_H;
+				cycles = 4;
+				NEXT;
+			OP(6D):  /* LD L, L */
+				cycles = 4;
+				NEXT;
+			OP(6E):  /* LD L, (HL) */
+				REG_L = readb(REG_HL);
+				cycles = 8;
+				NEXT;
+			/* 8bit loads: reg -> (HL) */
+			OP(70):  /* LD (HL), B */
+				writeb(REG_HL, REG_B);
+				cycles = 8;
+				NEXT;
+			OP(71):  /* LD (HL), C */
+				writeb(REG_HL, REG_C);
+				cycles = 8;
+				NEXT;
+			OP(72):  /* LD (HL), D */
+				writeb(REG_HL, REG_D);
+				cycles = 8;
+				NEXT;
+			OP(73):  /* LD (HL), E */
+				writeb(REG_HL, REG_E);
+				cycles = 8;
+				NEXT;
+			OP(74):  /* LD (HL), H */
+				writeb(REG_HL, REG_H);
+				cycles = 8;
+				NEXT;
+			OP(75):  /* LD (HL), L */
+				writeb(REG_HL, REG_L);
+				cycles = 8;
+				NEXT;
+			OP(36):  /* LD (HL), n */
+				writeb(REG_HL, IMM8);
+				cycles = 12;
+				NEXT;
+			OP(0A):  /* LD A, (BC) */
+				REG_A = readb(REG_BC);
+				cycles = 8;
+				NEXT;
+			OP(1A):  /* LD A, (DE) */
+				REG_A = readb(REG_DE);
+				cycles = 8;
+				NEXT;
+			OP(FA):  /* LD A, (nn) */
+				REG_A = readb(IMM16);
+				cycles = 16;
+				NEXT;
+			OP(3E):  /* LD A, n */
+				REG_A = IMM8;
+				cycles = 8;
+				NEXT;
+			OP(47):  /* LD B, A */
+				REG_B = REG_A;
+				cycles = 4;
+				NEXT;
+			OP(4F):  /* LD C, A */
+				REG_C = REG_A;
+				cycles = 4;
+				NEXT;
+			OP(57):  /* LD D, A */
+				REG_D = REG_A;
+				cycles = 4;
+				NEXT;
+			OP(5F):  /* LD E, A */
+				REG_E = REG_A;
+				cycles = 4;
+				NEXT;
+			OP(67):  /* LD H, A */
+				REG_H = REG_A;
+				cycles = 4;
+				NEXT;
+			OP(6F):  /* LD L, A */
+				REG_L = REG_A;
+				cycles = 4;
+				NEXT;
+			OP(02):  /* LD (BC), A */
+				writeb(REG_BC, REG_A);
+				cycles = 8;
+				NEXT;
+			OP(12):  /* LD (DE), A */
+				writeb(REG_DE, REG_A);
+				cycles = 8;
+				NEXT;
+			OP(77):  /* LD (HL), A */
+				writeb(REG_HL, REG_A);
+				cycles = 8;
+				NEXT;
+			OP(EA):  /* LD (nn), A */
+				writeb(IMM16, REG_A);
+				cycles = 16;
+				NEXT;
+			OP(F2):  /* LD A, (C) */
+				REG_A = readb(REG_C + 0xFF00);
+				cycles = 8;
+				NEXT;
+			OP(E2):  /* LD (C), A */
+				writeb(REG_C + 0xFF00, REG_A);
+				cycles = 8;
+				
+			NEXT;
+			/* 8bit loads/dec/inc */
+			OP(3A):  /* LDD A, (HL) */
+				REG_A = readb(REG_HL--);
+				cycles = 8;
+				NEXT;	
+			OP(32):  /* LDD (HL), A */
+				writeb(REG_HL--, REG_A);
+				cycles = 8;
+				NEXT;
+			OP(2A):  /* LDI A, (HL) */
+				REG_A = readb(REG_HL++);
+				cycles = 8;
+				NEXT;
+			OP(22):  /* LDI (HL), A */
+				writeb(REG_HL++, REG_A);
+				cycles = 8;
+				NEXT;
+			OP(E0):  /* LDH (n), A */
+				writeb(IMM8 + 0xFF00, REG_A);
+				cycles = 12;
+				NEXT;
+			OP(F0):  /* LDH A, (n) */
+				REG_A = readb(0xFF00 + IMM8);
+				cycles = 12;
+				NEXT;
+			/* 16bit loads */
+			OP(01):  /* LD BC, nn */
+				REG_BC = IMM16;
+				cycles = 12;
+				NEXT;
+			OP(11):  /* LD DE, nn */
+				REG_DE = IMM16;
+				cycles = 12;
+				NEXT;
+			OP(21):  /* LD HL, nn */
+				REG_HL = IMM16;
+				cycles = 12;
+				NEXT;
+			OP(31):  /* LD SP, nn */
+				REG_SP = IMM16;
+				cycles = 12;
+				NEXT;
+			OP(F9):  /* LD SP, HL */
+				REG_SP = REG_HL;
+				cycles = 8;
+				NEXT;
+			OP(F8):  /* LDHL SP, n */
+				REG_HL = add_wwb(REG_SP, IMM8);
+				cycles = 12;
+				NEXT;
+			OP(08): // LD (nn), SP
+				writew(IMM16, REG_SP);
+				cycles = 20;
+				NEXT;
+			OP(F5):	// PUSH AF
+				// Flags are stored in their own ints, not in REG_F, so we must
+				// produce REG_F here. (This is for efficiency reasons, only 
+				// PUSH AF and POP AF actually use REG_F/REG_AF)
+				REG_F = (FLAG_C << 4) | (FLAG_H << 5) | (FLAG_N << 6) 
+				              | (FLAG_Z << 7);
+				push(REG_AF);
+				cycles = 16;
+				NEXT;
+			OP(C5):	// PUSH BC
+				push(REG_BC);
+				cycles = 16;
+				NEXT;
+			OP(D5):	// PUSH DE
+				push(REG_DE);
+				cycles = 16;
+				NEXT;
+			OP(E5):	// PUSH HL
+				push(REG_HL);
+				cycles = 16;
+				NEXT;
+			OP(F1):	// POP AF
+				// Flags are stored in their own ints, not in REG_F, so we must
+				// produce the ints here. (This is for efficiency reasons, only 
+				// PUSH AF and POP AF actually use REG_F/REG_AF)
+				REG_AF = pop();
+				SET_C((REG_F & 0x10) >> 4); SET_H((REG_F & 0x20) >> 5);
+				SET_N((REG_F & 0x40) >> 6); SET_Z((REG_F & 0x80) >> 7);
+				cycles = 12;
+				NEXT;
+			OP(C1):	// POP BC
+				REG_BC = pop();
+				cycles = 12;
+				NEXT;
+			OP(D1):	// POP DE
+				REG_DE = pop();
+				cycles = 12;
+				NEXT;
+			OP(E1):	// POP HL
+				REG_HL = pop();
+				cycles = 12;
+				NEXT;
+			OP(87):	// ADD A, A
+				REG_A = add_bbb(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(80):	// ADD A, B
+				REG_A = add_bbb(REG_A, REG_B);
+				cycles = 4;
+				NEXT;
+			OP(81):	// ADD A, C
+				REG_A = add_bbb(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(82):	// ADD A, D
+				REG_A = add_bbb(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(83):	// ADD A, E
+				REG_A = add_bbb(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(84):	// ADD A, H
+				REG_A = add_bbb(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(85):	// ADD A, L
+				REG_A = add_bbb(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(86):	// ADD A, (HL)
+				REG_A = add_bbb(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(C6):	// ADD A, n
+				REG_A = add_bbb(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(8F):	// ADC A, A
+				REG_A = adc(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(88):	// ADC A, B
+				REG_A = adc(REG_A, REG_B);
+				cycles = 4;
+				NEXT;
+			OP(89):	// ADC A, C
+				REG_A = adc(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(8A):	// ADC A, D
+				REG_A = adc(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(8B):	// ADC A, E
+				REG_A = adc(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(8C):	// ADC A, H
+				REG_A = adc(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(8D):	// ADC A, L
+				REG_A = adc(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(8E):	// ADC A, (HL)
+				REG_A = adc(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(CE):	// ADC A, n
+				REG_A = adc(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(97):	// SUB A, A
+				REG_A = sub(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(90):	// SUB A, B
+				REG_A = sub(REG_A, REG_B);
+				cycles = 4;
+				NEXT;
+			OP(91):	// SUB A, C
+				REG_A = sub(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(92):	// SUB A, D
+				REG_A = sub(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(93):	// SUB A, E
+				REG_A = sub(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(94):	// SUB A, H
+				REG_A = sub(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(95):	// SUB A, L
+				REG_A = sub(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(96):	// SUB A, (HL)
+				REG_A = sub(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(D6):	// SUB A, n
+				REG_A = sub(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(9F):	// SBC A, A
+				REG_A = sbc(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(98):	// SBC A, B
+				REG_A = sbc(REG_A, REG_B);
+				cycles = 4;
+				NEXT;			
+			OP(99):	// SBC A, C
+				REG_A = sbc(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(9A):	// SBC A, D
+				REG_A = sbc(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(9B):	// SBC A, E
+				REG_A = sbc(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(9C):	// SBC A, H
+				REG_A = sbc(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(9D):	// SBC A, L
+				REG_A = sbc(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(9E):	// SBC A, (HL)
+				REG_A = sbc(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(DE):	// SBC A, n
+				REG_A = sbc(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(A7):	// AND A
+				REG_A = and(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(A0):	// AND B
+				REG_A = and(REG_A, REG_B);
+				cycles = 4;
+				NEXT;
+			OP(A1):	// AND C
+				REG_A = and(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(A2):	// AND D
+				REG_A = and(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(A3):	// AND E
+				REG_A = and(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(A4):	// AND H
+				REG_A = and(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(A5):	// AND L
+				REG_A = and(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(A6):	// AND (HL)
+				REG_A = and(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(E6):	// AND n
+				REG_A = and(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(B7):	// OR A
+				REG_A = or(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(B0):	// OR B
+				REG_A = or(REG_A, REG_B);
+				cycles = 4;
+				NEXT;
+			OP(B1):	// OR C
+				REG_A = or(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(B2):	// OR D
+				REG_A = or(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(B3):	// OR E
+				REG_A = or(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(B4):	// OR H
+				REG_A = or(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(B5):	// OR L
+				REG_A = or(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(B6):	// OR (HL)
+				REG_A = or(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(F6):	// OR n
+				REG_A = or(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(AF):	// XOR A
+				REG_A = xor(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(A8):	// XOR B
+				REG_A = xor(REG_A, REG_B);
+				cycles = 4;
+				NEXT;
+			OP(A9):	// XOR C
+				REG_A = xor(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(AA):	// XOR D
+				REG_A = xor(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(AB):	// XOR E
+				REG_A = xor(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(AC):	// XOR H
+				REG_A = xor(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(AD):	// XOR L
+				REG_A = xor(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(AE):	// XOR (HL)
+				REG_A = xor(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(EE):	// XOR n
+				REG_A = xor(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(BF):	// CP A
+				sub(REG_A, REG_A);
+				cycles = 4;
+				NEXT;
+			OP(B8):	// CP B
+				sub(REG_A, REG_B);
+				cycles = 4;
+				NEXT;
+			OP(B9):	// CP C
+				sub(REG_A, REG_C);
+				cycles = 4;
+				NEXT;
+			OP(BA):	// CP D
+				sub(REG_A, REG_D);
+				cycles = 4;
+				NEXT;
+			OP(BB):	// CP E
+				sub(REG_A, REG_E);
+				cycles = 4;
+				NEXT;
+			OP(BC):	// CP H
+				sub(REG_A, REG_H);
+				cycles = 4;
+				NEXT;
+			OP(BD):	// CP L
+				sub(REG_A, REG_L);
+				cycles = 4;
+				NEXT;
+			OP(BE):	// CP (HL)
+				sub(REG_A, readb(REG_HL));
+				cycles = 8;
+				NEXT;
+			OP(FE):	// CP n
+				sub(REG_A, IMM8);
+				cycles = 8;
+				NEXT;
+			OP(3C):	// INC A
+				REG_A = inc_bb(REG_A);
+				cycles = 4;
+				NEXT;
+			OP(04):	// INC B
+				REG_B = inc_bb(REG_B);
+				cycles = 4;
+				NEXT;
+			OP(0C):	// INC C
+				REG_C = inc_bb(REG_C);
+				cycles = 4;
+				NEXT;
+			OP(14):	// INC D
+				REG_D = inc_bb(REG_D);
+				cycles = 4;
+				NEXT;
+			OP(1C):	// INC E
+				REG_E = inc_bb(REG_E);
+				cycles = 4;
+				NEXT;
+			OP(24):	// INC H
+				REG_H = inc_bb(REG_H);
+				cycles = 4;
+				NEXT;
+			OP(2C):	// INC L
+				REG_L = inc_bb(REG_L);
+				cycles = 4;
+				NEXT;
+			OP(34):	// INC (HL)
+				writeb(REG_HL, inc_bb(readb(REG_HL)));
+				cycles = 12;
+				NEXT;
+			OP(3D):	// DEC A
+				REG_A = dec_bb(REG_A);
+				cycles = 4;
+				NEXT;
+			OP(05):	// DEC B
+				REG_B = dec_bb(REG_B);
+				cycles = 4;
+				NEXT;
+			OP(0D):	// DEC C
+				REG_C = dec_bb(REG_C);
+				cycles = 4;
+				NEXT;
+			OP(15):	// DEC D
+				REG_D = dec_bb(REG_D);
+				cycles = 4;
+				NEXT;
+			OP(1D):	// DEC E
+				REG_E = dec_bb(REG_E);
+				cycles = 4;
+				NEXT;
+			OP(25):	// DEC H
+				REG_H = dec_bb(REG_H);
+				cycles = 4;
+				NEXT;
+			OP(2D):	// DEC L
+				REG_L = dec_bb(REG_L);
+				cycles = 4;
+				NEXT;
+			OP(35):	// DEC (HL)
+				writeb(REG_HL, dec_bb(readb(REG_HL)));
+				cycles = 12;
+				NEXT;
+			OP(09):	// ADD HL, BC
+				REG_HL = add_www(REG_HL, REG_BC);
+				cycles = 8;
+				NEXT;
+			OP(19):	// ADD HL, DE
+				REG_HL = add_www(REG_HL, REG_DE);
+				cycles = 8;
+				NEXT;
+			OP(29):	// ADD HL, HL
+				REG_HL = add_www(REG_HL, REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(39):	// ADD HL, SP
+				REG_HL = add_www(REG_HL, REG_SP);
+				cycles = 8;
+				NEXT;
+			OP(E8):	// ADD SP, n
+				REG_SP = add_wwb(REG_SP, IMM8);
+				cycles = 16;
+				NEXT;
+			OP(03):	// INC BC
+				REG_BC = inc_ww(REG_BC);
+				cycles = 8;
+				NEXT;
+			OP(13):	// INC DE
+				REG_DE = inc_ww(REG_DE);
+				cycles = 8;
+				NEXT;
+			OP(23):	// INC HL
+				REG_HL = inc_ww(REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(33):	// INC SP
+				REG_SP = inc_ww(REG_SP);
+				cycles = 8;
+				NEXT;
+			OP(0B):	// DEC BC
+				REG_BC = dec_ww(REG_BC);
+				cycles = 8;
+				NEXT;
+			OP(1B):	// DEC DE
+				REG_DE = dec_ww(REG_DE);
+				cycles = 8;
+				NEXT;
+			OP(2B):	// DEC HL
+				REG_HL = dec_ww(REG_HL);
+				cycles = 8;
+				NEXT;
+			OP(3B):	// DEC SP
+				REG_SP = dec_ww(REG_SP);
+				cycles = 8;
+				NEXT;
+			OP(CB):	// Some two byte opcodes here.
+				opcode = IMM8;
+				DISPATCH_CB(opcode);
+					CB(37):	// SWAP A
+						REG_A = swap(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(30):	// SWAP B
+						REG_B = swap(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(31):	// SWAP C
+						REG_C = swap(REG_C);
+						cycles = 8;
+						NEXT;
+					CB(32):	// SWAP D
+						REG_D = swap(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(33):	// SWAP E
+						REG_E = swap(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(34):	// SWAP H
+						REG_H = swap(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(35):	// SWAP L
+						REG_L = swap(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(36):	// SWAP (HL)
+						writeb(REG_HL, swap(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB(07):	// RLC A
+						REG_A = rlc(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(00):	// RLC B
+						REG_B = rlc(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(01):	// RLC C
+						REG_C = rlc(REG_C);
+						cycles = 8;
+						NEXT;
+					CB(02):	// RLC D
+						REG_D = rlc(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(03):	// RLC E
+						REG_E = rlc(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(04):	// RLC H
+						REG_H = rlc(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(05):	// RLC L
+						REG_L = rlc(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(06):	// RLC (HL)
+						writeb(REG_HL, rlc(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB(17):	// RL A
+						REG_A = rl(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(10):	// RL B
+						REG_B = rl(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(11):	// RL C
+						REG_C = rl(REG_C);
+						cycles = 8;
+						NEXT;
+					CB(12):	// RL D
+						REG_D = rl(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(13):	// RL E
+						REG_E = rl(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(14):	// RL H
+						REG_H = rl(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(15):	// RL L
+						REG_L = rl(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(16):	// RL (HL)
+						writeb(REG_HL, rl(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB(0F):	// RRC A
+						REG_A = rrc(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(08):	// RRC B
+						REG_B = rrc(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(09):	// RRC C
+						REG_C = rrc(REG_C);
+						cycles = 8;
+						NEXT;
+					CB(0A):	// RRC D
+						REG_D = rrc(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(0B):	// RRC E
+						REG_E = rrc(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(0C):	// RRC H
+						REG_H = rrc(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(0D):	// RRC L
+						REG_L = rrc(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(0E):	// RRC (HL)
+						writeb(REG_HL, rrc(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB(1F):	// RR A
+						REG_A = rr(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(18):	// RR B
+						REG_B = rr(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(19):	// RR C
+						REG_C = rr(REG_C);
+						cycles = 8;
+						NEXT;
+					CB(1A):	// RR D
+						REG_D = rr(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(1B):	// RR E
+						REG_E = rr(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(1C):	// RR H
+						REG_H = rr(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(1D):	// RR L
+						REG_L = rr(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(1E):	// RR (HL)
+						writeb(REG_HL, rr(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB(27):	// SLA A
+						REG_A = sla(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(20):	// SLA B
+						REG_B = sla(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(21):	// SLA C
+						REG_C = sla(REG_C);
+						cycles = 8;
+						NEXT;			
+					CB(22):	// SLA D
+						REG_D = sla(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(23):	// SLA E
+						REG_E = sla(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(24):	// SLA H
+						REG_H = sla(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(25):	// SLA L
+						REG_L = sla(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(26):	// SLA (HL)
+						writeb(REG_HL, sla(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB(2F):	// SRA A
+						REG_A = sra(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(28):	// SRA B
+						REG_B = sra(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(29):	// SRA C
+						REG_C = sra(REG_C);
+						cycles = 8;
+						NEXT;			
+					CB(2A):	// SRA D
+						REG_D = sra(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(2B):	// SRA E
+						REG_E = sra(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(2C):	// SRA H
+						REG_H = sra(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(2D):	// SRA L
+						REG_L = sra(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(2E):	// SRA (HL)
+						writeb(REG_HL, sra(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB(3F):	// SRL A
+						REG_A = srl(REG_A);
+						cycles = 8;
+						NEXT;
+					CB(38):	// SRL B
+						REG_B = srl(REG_B);
+						cycles = 8;
+						NEXT;
+					CB(39):	// SRL C
+						REG_C = srl(REG_C);
+						cycles = 8;
+						NEXT;			
+					CB(3A):	// SRL D
+						REG_D = srl(REG_D);
+						cycles = 8;
+						NEXT;
+					CB(3B):	// SRL E
+						REG_E = srl(REG_E);
+						cycles = 8;
+						NEXT;
+					CB(3C):	// SRL H
+						REG_H = srl(REG_H);
+						cycles = 8;
+						NEXT;
+					CB(3D):	// SRL L
+						REG_L = srl(REG_L);
+						cycles = 8;
+						NEXT;
+					CB(3E):	// SRL (HL)
+						writeb(REG_HL, srl(readb(REG_HL)));
+						cycles = 16;
+						NEXT;
+					CB_GROUP(40):	// BIT b, B
+						bit(REG_B, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(41):	// BIT b, C
+						bit(REG_C, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(42):	// BIT b, D
+						bit(REG_D, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(43):	// BIT b, E
+						bit(REG_E, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(44):	// BIT b, H
+						bit(REG_H, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(45):	// BIT b, L
+						bit(REG_L, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(46):	// BIT b, (HL)
+						bit(readb(REG_HL), (opcode & 0x38) >> 3);
+						cycles = 12;
+						NEXT;
+					CB_GROUP(47):	// BIT b, A
+						bit(REG_A, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(C0):	// SET b, B
+						REG_B = set(REG_B, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(C1):	// SET b, C
+						REG_C = set(REG_C, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(C2):	// SET b, D
+						REG_D = set(REG_D, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(C3):	// SET b, E
+						REG_E = set(REG_E, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(C4):	// SET b, H
+						REG_H = set(REG_H, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(C5):	// SET b, L
+						REG_L = set(REG_L, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(C6):	// SET b, (HL)
+						writeb(REG_HL, set(readb(REG_HL), (opcode & 0x38) >> 3));
+						cycles = 16;
+						NEXT;
+					CB_GROUP(C7):	// SET b, A
+						REG_A = set(REG_A, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(80):	// RES b, B
+						REG_B = res(REG_B, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(81):	// RES b, C
+						REG_C = res(REG_C, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(82):	// RES b, D
+						REG_D = res(REG_D, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(83):	// RES b, E
+						REG_E = res(REG_E, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(84):	// RES b, H
+						REG_H = res(REG_H, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(85):	// RES b, L
+						REG_L = res(REG_L, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+					CB_GROUP(86):	// RES b, (HL)
+						writeb(REG_HL, res(readb(REG_HL), (opcode & 0x38) >> 3));
+						cycles = 16;
+						NEXT;
+					CB_GROUP(87):	// RES b, A
+						REG_A = res(REG_A, (opcode & 0x38) >> 3);
+						cycles = 8;
+						NEXT;
+				END_CB;
+
+			OP(27):   // DAA
+				REG_A = daa(REG_A);
+				cycles = 4;
+				NEXT;
+			OP(2F):   // CPL
+				REG_A = ~REG_A;
+				SET_N(1);
+				SET_H(1);
+				cycles = 4;
+				NEXT;
+			OP(3F):   // CCF
+				if (FLAG_C != 0)
+					SET_C(0);
+				else
+					SET_C(1);
+				SET_N(0);
+				SET_H(0);
+				cycles = 4;
+				NEXT;
+			OP(37):   // SCF
+				SET_C(1);
+				SET_N(0);
+				SET_H(0);
+				cycles = 4;
+				NEXT;
+			OP(76):   // HALT
+				core.is_halted = 1;
+				cycles = 4;
+				NEXT;
+			OP(10):   // STOP
+				SKIP(1);		/* skip over the 0x00 */
+				/* has a speed switch been requested? */
+				if ((read_io(HWREG_KEY1) & 0x01) && 
+						(console_mode = MODE_GBC_ENABLED)) {
+				fprintf(stderr, "speed switch");
+					if (core.frequency == FREQ_NORMAL) {
+						core.frequency = FREQ_DOUBLE;
+						write_io(HWREG_KEY1, 0x80);
+					}
+					else if (core.frequency == FREQ_DOUBLE) {
+						core.frequency = FREQ_NORMAL;
+						write_io(HWREG_KEY1, 0x00);
+					}
+				} else
+					core.is_stopped = 1;
+				cycles = 4;
+				NEXT;
+			OP(F3):	// DI
+				set_ime(0);
+				cycles = 4;
+				NEXT;
+			OP(FB):	// EI
+				core.ei = 3;
+				//ime_ = 1;
+				cycles = 4;
+				NEXT;
+			OP(07):	// RLCA
+				REG_A = rlc(REG_A);
+				SET_Z(0);
+				cycles = 4;
+				NEXT;
+			OP(17):	// RLA
+				REG_A = rl(REG_A);
+				SET_Z(0);
+				cycles = 4;
+				NEXT;
+			OP(0F):	// RRCA
+				REG_A = rrc(REG_A);
+				SET_Z(0);
+				cycles = 4;
+				NEXT;
+			OP(1F):	// RRA
+				REG_A = rr(REG_A);
+				SET_Z(0);
+				cycles = 4;
+				NEXT;
+			OP(C3):   // JP imm
+				REG_PC = IMM16;
+				cycles = 16;
+				IDLE_CHECK();
+				NEXT;
+			OP(C2): 	// JP NZ, nn
+				if (FLAG_Z == 0) {
+					REG_PC = IMM16;
+					cycles = 16;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(2);
+				cycles = 12;
+				NEXT;
+			OP(CA): 	// JP Z, nn
+				if (FLAG_Z != 0) {
+					REG_PC = IMM16;
+					cycles = 16;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(2);
+				cycles = 12;
+				NEXT;
+			OP(D2): 	// JP NC, nn
+				if (FLAG_C == 0) {
+					REG_PC = IMM16;
+					cycles = 16;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(2);
+				cycles = 12;
+				NEXT;
+			OP(DA): 	// JP C, nn
+				if (FLAG_C != 0) {
+					REG_PC = IMM16;
+					cycles = 16;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(2);
+				cycles = 12;
+				NEXT;
+			OP(E9):   // JP HL
+				REG_PC = REG_HL;
+				cycles = 4;
+				NEXT;
+			OP(18):   // JR n
+				jr(IMM8);
+				cycles = 12;
+				IDLE_CHECK();
+				NEXT;
+			OP(20):   // JR NZ, n
+				if (FLAG_Z == 0) {
+					jr(IMM8);
+					cycles = 12;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(1);
+				cycles = 8;
+				NEXT;
+			OP(28):   // JR Z, n
+				if (FLAG_Z != 0) {
+					jr(IMM8);
+					cycles = 12;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(1);
+				cycles = 8;
+				NEXT;
+			OP(30):   // JR NC, n
+				if (FLAG_C == 0) {
+					jr(IMM8);
+					cycles = 12;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(1);
+				cycles = 8;
+				NEXT;
+			OP(38):   // JR C, n
+				if (FLAG_C != 0) {
+					jr(IMM8);
+					cycles = 12;
+					IDLE_CHECK();
+					NEXT;
+				}
+				SKIP(1);
+				cycles = 8;
+				NEXT;
+			OP(CD):	// CALL nn
+				call(IMM16);
+				cycles = 24;
+				NEXT;
+			OP(C4):	// CALL NZ, nn
+				if (FLAG_Z == 0) {
+					call(IMM16);
+					cycles = 24;
+					NEXT;
+				}
+				cycles = 12;
+				SKIP(2);
+				NEXT;
+			OP(CC):	// CALL Z, nn
+				if (FLAG_Z != 0) {
+					call(IMM16);
+					cycles = 24;
+					NEXT;
+				}
+				cycles = 12;
+				SKIP(2);
+				NEXT;
+			OP(D4):	// CALL NC, nn
+				if (FLAG_C == 0) {
+					call(IMM16);
+					cycles = 24;
+					NEXT;
+				}
+				cycles = 12;
+				SKIP(2);
+				NEXT;
+			OP(DC):	// CALL C, nn
+				if (FLAG_C != 0) {
+					call(IMM16);
+					cycles = 24;
+					NEXT;
+				}
+				cycles = 12;
+				SKIP(2);
+				NEXT;
+			OP(C7):	// RST 0x00
+				rst(0x00);
+				cycles = 16;
+				NEXT;
+			OP(CF):	// RST 0x08
+				rst(0x08);
+				cycles = 16;
+				NEXT;
+			OP(D7):	// RST 0x10
+				rst(0x10);
+				cycles = 16;
+				NEXT;
+			OP(DF):	// RST 0x18
+				rst(0x18);
+				cycles = 16;
+				NEXT;
+			OP(E7):	// RST 0x20
+				rst(0x20);
+				cycles = 16;
+				NEXT;
+			OP(EF):	// RST 0x28
+				rst(0x28);
+				cycles = 16;
+				NEXT;
+			OP(F7):	// RST 0x30
+				rst(0x30);
+				cycles = 16;
+				NEXT;
+			OP(FF):	// RST 0x38
+				rst(0x38);
+				cycles = 16;
+				NEXT;
+			OP(C9):	// RET
+				ret();
+				cycles = 16;
+				NEXT;
+			OP(C0):	// RET NZ
+				if (FLAG_Z == 0) {
+					ret();
+					cycles = 20;
+					NEXT;
+				}
+				cycles = 8;
+				NEXT;
+			OP(C8):	// RET Z
+				if (FLAG_Z != 0) {
+					ret();
+					cycles = 20;
+					NEXT;
+				}
+				cycles = 8;
+				NEXT;
+			OP(D0):	// RET NC
+				if (FLAG_C == 0) {
+					ret();
+					cycles = 20;
+					NEXT;
+				}
+				cycles = 8;
+				NEXT;
+			OP(D8):	// RET C
+				if (FLAG_C != 0) {
+					ret();
+					cycles = 20;
+					NEXT;
+				}
+				cycles = 8;
+				NEXT;
+			OP(D9):	// RETI
+				ret();
+				set_ime(1);
+				cycles = 16;
+				NEXT;
+			OP(00):  // NOP
+				cycles = 4;
+				NEXT;
+			OP(ED):	// DEBUG
+				getchar();
+				NEXT;
+#if 0
+			/* debugging instructions (ie. not on real gameboy) */
+			case 0xD3:	// DUMP
+				dumpState();
+				break;
+			case 0xDB:	// DMPB
+				cout << hex << "DMPB: 0x" << readw(REG_PC) << ": 0x" 
+				     << (unsigned int) readb(readw(REG_PC)) << dec << endl;
+				REG_PC += 2;
+				break;
+			case 0xDD:	// DMPW
+				cout << hex << "DMPW: 0x" << readw(REG_PC) << ": 0x"
+				<< readw(readw(REG_PC)) << dec << endl;
+				REG_PC += 2;
+				break;
+			case 0xE3:	// BRK
+				exit(1);
+#endif
+			OP_INVALID:
+				printf("invalid opcode: %hhx ", readb(REG_PC - 1));
+				printf("at %hx\n", REG_PC - 1);
+				dump_state();
+				NEXT;
+		END_DISPATCH;
+
+#ifdef CORE_THREADED
+op_next:
+#endif
+#ifdef CORE_BLOCK_CACHE
+		/* carry on with the block until the time slice runs out, unless the
+		 * last op (one that wrote memory or read the timer) made an
+		 * interrupt ready to be taken or switched the rom bank under it */
+		if (mop != NULL) {
+			if (mop != mop_end && total_cycles + cycles < max_cycles &&
+					!(mop[-1].checks && (block_abort || core.int_ready))) {
+				total_cycles += cycles;
+				sound_cycles += cycles;
+				core.cycles += cycles;
+				continue;
+			}
+			mop = NULL;
+		}
+#endif
+#ifdef CORE_THREADED
+		/* stay in the threaded loop until something needs the slow path:
+		 * a pending EI, the debugger, a pending interrupt, a halt, or the
+		 * end of the time slice */
+		if (!(core.ei | core.is_halted | EXECUTE_DEBUG)) {
+			total_cycles += cycles;
+			sound_cycles += cycles;
+			core.cycles += cycles;
+			if (total_cycles >= max_cycles || core.int_pending)
+				continue;
+			cycles = 0;
+			BLOCK_ENTER();
+			FETCH();
+			DISPATCH(opcode);
+		}
+#endif
+
+		// EI only enables ints after the next instruction.
+		if (core.ei != 0) {
+			--core.ei;
+			if (core.ei == 1)
+				set_ime(1);
+		}
+
+#if EXECUTE_DEBUG
+		if (profiling)
+			profile_done(cycles);
+		if (debug_watch())
+			debugging = 1;
+		if (debugging)
+			dump_state();
+#endif
+
+		total_cycles += cycles;
+		sound_cycles += cycles;
+		core.cycles += cycles;
+		
+	}
+
+	return total_cycles;
+}
@@ -0,0 +1,222 @@
+/*
+ * forkserver.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "forkserver.h"
+#include "libgbem.h"
+
+#define FORK_WATCHES		16		/* bytes a request can watch */
+#define FORK_RAMS			16		/* and ranges of memory it can ask for */
+
+typedef struct {
+	unsigned int frames;
+	unsigned int buttons;
+} ForkInput;
+
+typedef struct {
+	ForkInput *input;
+	unsigned int inputs;
+	int is_hashing;
+	unsigned int watch[FORK_WATCHES];
+	unsigned int watches;
+	unsigned int ram[FORK_RAMS][2];		/* address and length */
+	unsigned int rams;
+} ForkRequest;
+
+/* at the checkpoint, in the server */
+static struct GbInstance *game;
+
+/* read a request up to its run line. Returns NULL if it is good, or what
+ * is wrong with it */
+static const char *read_request(FILE *in, ForkRequest *req) {
+	char *line = NULL;
+	size_t size = 0;
+	char word[16];
+	const char *err = "request has no run";
+	long a, b;
+	int n;
+
+	while (getline(&line, &size, in) > 0) {
+		n = sscanf(line, "%15s %li %li", word, &a, &b);
+		if (n < 1)
+			continue;
+		if (strcmp(word, "run") == 0) {
+			err = NULL;
+			break;
+		}
+		if (strcmp(word, "input") == 0 && n == 3 && a >= 0) {
+			req->input = realloc(req->input,
+			                     (req->inputs + 1) * sizeof(ForkInput));
+			req->input[req->inputs].frames = a;
+			req->input[req->inputs].buttons = b & 0xFF;
+			++req->inputs;
+		} else if (strcmp(word, "hash") == 0) {
+			req->is_hashing = 1;
+		} else if (strcmp(word, "watch") == 0 && n >= 2 &&
+		           req->watches < FORK_WATCHES && a >= 0 && a < 0x10000) {
+			req->watch[req->watches++] = a;
+		} else if (strcmp(word, "ram") == 0 && n == 3 && req->rams < FORK_RAMS &&
+		           a >= 0 && b >= 0 && a + b <= 0x10000) {
+			req->ram[req->rams][0] = a;
+			req->ram[req->rams][1] = b;
+			++req->rams;
+		} else {
+			err = "bad request line";
+			break;
+		}
+	}
+	free(line);
+	return err;
+}
+
+static void play(FILE *out, const ForkRequest *req) {
+	unsigned int i, j, k, f = 0;
+
+	for (i = 0; i < req->inputs; i++) {
+		gbem_set_buttons(game, req->input[i].buttons);
+		for (j = 0; j < req->input[i].frames; j++, f++) {
+			gbem_run_frame(game);
+			if (!req->is_hashing && req->watches == 0)
+				continue;
+			fprintf(out, "frame %u", f);
+			if (req->is_hashing)
+				fprintf(out, " %016llx",
+				        (unsigned long long)gbem_frame_hash(game));
+			for (k = 0; k < req->watches; k++)
+				fprintf(out, " %02x", gbem_peek(game, req->watch[k]));
+			fputc('\n', out);
+		}
+	}
+	for (i = 0; i < req->rams; i++) {
+		fprintf(out, "ram %04x ", req->ram[i][0]);
+		for (j = 0; j < req->ram[i][1]; j++)
+			fprintf(out, "%02x", gbem_peek(game, req->ram[i][0] + j));
+		fputc('\n', out);
+	}
+	fprintf(out, "done %u\n", f);
+}
+
+/* in the child, with the connection */
+static void serve(int fd) {
+	FILE *in, *out;
+	ForkRequest req;
+	const char *err;
+
+	in = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+	if (in == NULL || out == NULL) {
+		perror("fdopen");
+		return;
+	}
+	memset(&req, 0, sizeof(req));
+	err = read_request(in, &req);
+	if (err != NULL)
+		fprintf(out, "error %s\n", err);
+	else
+		play(out, &req);
+	free(req.input);
+	fclose(out);
+	fclose(in);
+}
+
+int forkserver_main(int argc, char *argv[]) {
+	struct sockaddr_un addr;
+	unsigned int frames = 0, f;
+	int listener, fd;
+	pid_t pid;
+
+	if (argc < 4) {
+		printf("%s -forkserver rom socket [frames [movie]]\n", argv[0]);
+		return 1;
+	}
+	if (argc >= 5)
+		frames = atoi(argv[4]);
+	if (strlen(argv[3]) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "%s: socket path too long\n", argv[3]);
+		return 1;
+	}
+
+	game = gbem_new();
+	if (gbem_load_rom_file(game, argv[2]) != 0)
+		return 1;
+	if (argc >= 6 && gbem_movie_play_file(game, argv[5]) != 0)
+		return 1;
+	for (f = 0; f < frames; f++)
+		gbem_run_frame(game);
+	/* the children play their own input */
+	gbem_movie_stop(game);
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, argv[3]);
+	unlink(argv[3]);
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0 || bind(listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(listener, SOMAXCONN) < 0) {
+		perror(argv[3]);
+		return 1;
+	}
+	/* nothing waits for the children, so don't leave them as zombies */
+	signal(SIGCHLD, SIG_IGN);
+	fprintf(stderr, "checkpoint at frame %u, serving on %s\n", frames, argv[3]);
+	fflush(stdout);
+
+	while (1) {
+		fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			perror("accept");
+			break;
+		}
+		pid = fork();
+		if (pid == 0) {
+			close(listener);
+			serve(fd);
+			/* without writing the sram file, or flushing what the server
+			 * had buffered, on the way out */
+			_exit(0);
+		}
+		if (pid < 0)
+			perror("fork");
+		close(fd);
+	}
+	close(listener);
+	return 1;
+}
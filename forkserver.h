@@ -0,0 +1,61 @@
+/*
+ * forkserver.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FORKSERVER_H
+#define _FORKSERVER_H
+
+/* gbem -forkserver rom socket [frames [movie]]: runs the rom headless to a
+ * checkpoint, frames in (playing the input movie if given, see movie.h),
+ * then serves requests on a unix socket. Each connection is handled by a
+ * child forked from the checkpoint, so it starts from there at once and
+ * shares the rom and whatever memory it doesn't change with the server
+ * and its other children. The server never runs the game itself again.
+ *
+ * A request is lines of
+ *
+ *	input frames buttons	hold the buttons (a GBEM_* mask, see
+ *							libgbem.h) for that many frames
+ *	hash					report each frame's hash (see framehash.h)
+ *	watch address			report the byte at address after each frame
+ *	ram address length		send the bytes there once the inputs are done
+ *	run						play it
+ *
+ * with numbers as for strtol(), so 0x for hex. The reply is lines of
+ *
+ *	frame n [hash] [watched bytes ...]	after each frame, if asked for
+ *	ram address bytes					in hex
+ *	done frames
+ *
+ * or "error message" if the request is no good. Frames count from 0 at
+ * the checkpoint. The connection is closed after the reply. */
+int forkserver_main(int argc, char *argv[]);
+
+#endif /* _FORKSERVER_H */
@@ -0,0 +1,247 @@
+/*
+ * framehash.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framehash.h"
+#include "display.h"
+
+#define FRAMEHASH_MAGIC_SIZE	4
+#define FRAMEHASH_HEADER		(FRAMEHASH_MAGIC_SIZE + 1)
+
+#define PRIME1		0x9E3779B185EBCA87ULL
+#define PRIME2		0xC2B2AE3D27D4EB4FULL
+#define PRIME3		0x165667B19E3779F9ULL
+#define PRIME4		0x85EBCA77C2B2AE63ULL
+#define PRIME5		0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl(uint64_t x, int r) {
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t read64(const Byte *p) {
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint32_t read32(const Byte *p) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline uint64_t mix(uint64_t acc, uint64_t in) {
+	acc += in * PRIME2;
+	return rotl(acc, 31) * PRIME1;
+}
+
+static inline uint64_t merge(uint64_t h, uint64_t acc) {
+	h ^= mix(0, acc);
+	return h * PRIME1 + PRIME4;
+}
+
+/* xxh64 with a seed of 0, reading words in host order */
+uint64_t hash64(const void *data, size_t size) {
+	const Byte *p = data, *end = p + size;
+	uint64_t h;
+
+	if (size >= 32) {
+		uint64_t v1 = PRIME1 + PRIME2, v2 = PRIME2, v3 = 0, v4 = -PRIME1;
+
+		do {
+			v1 = mix(v1, read64(p));
+			v2 = mix(v2, read64(p + 8));
+			v3 = mix(v3, read64(p + 16));
+			v4 = mix(v4, read64(p + 24));
+			p += 32;
+		} while (p + 32 <= end);
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+		h = merge(h, v1);
+		h = merge(h, v2);
+		h = merge(h, v3);
+		h = merge(h, v4);
+	} else {
+		h = PRIME5;
+	}
+	h += size;
+	for (; p + 8 <= end; p += 8) {
+		h ^= mix(0, read64(p));
+		h = rotl(h, 27) * PRIME1 + PRIME4;
+	}
+	if (p + 4 <= end) {
+		h ^= read32(p) * PRIME1;
+		h = rotl(h, 23) * PRIME2 + PRIME3;
+		p += 4;
+	}
+	for (; p < end; p++) {
+		h ^= *p * PRIME5;
+		h = rotl(h, 11) * PRIME1;
+	}
+	h ^= h >> 33;
+	h *= PRIME2;
+	h ^= h >> 29;
+	h *= PRIME3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t frame_hash(const uint32_t *frame) {
+	return hash64(frame, DISPLAY_W * DISPLAY_H * sizeof(uint32_t));
+}
+
+/* the hashes of a log file, NULL if it isn't one */
+static uint64_t *load_log(const char *fn, unsigned int *count) {
+	FILE *fp;
+	Byte header[FRAMEHASH_HEADER], b[8];
+	uint64_t *hash = NULL;
+	unsigned int capacity = 0, i;
+
+	fp = fopen(fn, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "could not open frame hashes: %s\n", fn);
+		perror("fopen");
+		return NULL;
+	}
+	if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+	    memcmp(header, FRAMEHASH_MAGIC, FRAMEHASH_MAGIC_SIZE) != 0) {
+		fprintf(stderr, "%s: not a frame hash log\n", fn);
+		fclose(fp);
+		return NULL;
+	}
+	if (header[4] != FRAMEHASH_VERSION) {
+		fprintf(stderr, "%s: frame hash log version %u not supported\n",
+		        fn, header[4]);
+		fclose(fp);
+		return NULL;
+	}
+	*count = 0;
+	while (fread(b, 1, sizeof(b), fp) == sizeof(b)) {
+		if (*count == capacity) {
+			capacity = capacity ? capacity * 2 : 1024;
+			hash = realloc(hash, capacity * sizeof(uint64_t));
+		}
+		hash[*count] = 0;
+		for (i = 0; i < 8; i++)
+			hash[*count] |= (uint64_t)b[i] << (i * 8);
+		++*count;
+	}
+	fclose(fp);
+	/* an empty log still isn't NULL */
+	if (hash == NULL)
+		hash = malloc(sizeof(uint64_t));
+	return hash;
+}
+
+FrameLog *framelog_new(const char *golden_fn) {
+	FrameLog *log = calloc(1, sizeof(FrameLog));
+
+	log->diverged = -1;
+	if (golden_fn != NULL) {
+		log->golden = load_log(golden_fn, &log->golden_count);
+		if (log->golden == NULL) {
+			free(log);
+			return NULL;
+		}
+	}
+	return log;
+}
+
+void framelog_free(FrameLog *log) {
+	if (log == NULL)
+		return;
+	free(log->hash);
+	free(log->golden);
+	free(log);
+}
+
+/* back to before the first frame, for a reset */
+void framelog_rewind(FrameLog *log) {
+	log->count = 0;
+	log->diverged = -1;
+}
+
+void framelog_add(FrameLog *log, const uint32_t *frame) {
+	uint64_t h = frame_hash(frame);
+
+	if (log->count == log->capacity) {
+		log->capacity = log->capacity ? log->capacity * 2 : 1024;
+		log->hash = realloc(log->hash, log->capacity * sizeof(uint64_t));
+	}
+	if (log->golden != NULL && log->diverged < 0 &&
+	    log->count < log->golden_count && h != log->golden[log->count]) {
+		log->diverged = log->count;
+		fprintf(stderr, "frame %u differs from the golden log: "
+		        "%016llx, not %016llx\n", log->count, (unsigned long long)h,
+		        (unsigned long long)log->golden[log->count]);
+	}
+	log->hash[log->count++] = h;
+}
+
+int framelog_save(const FrameLog *log, const char *fn) {
+	FILE *fp;
+	Byte b[8];
+	unsigned int f, i;
+
+	fp = fopen(fn, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "could not open frame hashes for writing: %s\n", fn);
+		perror("fopen");
+		return -1;
+	}
+	fwrite(FRAMEHASH_MAGIC, 1, FRAMEHASH_MAGIC_SIZE, fp);
+	fputc(FRAMEHASH_VERSION, fp);
+	for (f = 0; f < log->count; f++) {
+		for (i = 0; i < 8; i++)
+			b[i] = log->hash[f] >> (i * 8);
+		fwrite(b, 1, sizeof(b), fp);
+	}
+	fclose(fp);
+	return 0;
+}
+
+void framelog_report(const FrameLog *log, FILE *fp) {
+	if (log->golden == NULL)
+		fprintf(fp, "%u frames hashed\n", log->count);
+	else if (log->diverged >= 0)
+		fprintf(fp, "frames differ from the golden log from frame %ld, "
+		        "of %u\n", log->diverged, log->count);
+	else if (log->count > log->golden_count)
+		fprintf(fp, "%u frames match, the golden log stops there\n",
+		        log->golden_count);
+	else if (log->count < log->golden_count)
+		fprintf(fp, "%u frames match, of %u in the golden log\n",
+		        log->count, log->golden_count);
+	else
+		fprintf(fp, "all %u frames match\n", log->count);
+}
@@ -0,0 +1,76 @@
+/*
+ * framehash.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _FRAMEHASH_H
+#define _FRAMEHASH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "gbem.h"
+
+/* frame hashes: a 64 bit hash of each finished frame, taken at the start
+ * of vblank, so two builds given the same rom and input can be checked
+ * against each other frame by frame. The hash is xxh64 of the frame's
+ * pixels as they are in memory, which at a few tens of microseconds a
+ * frame is cheap enough to leave on while benchmarking. Frames the lcd
+ * doesn't draw, while it is off, aren't logged, and neither are frames
+ * skipped or drawn as shades (see display_skip() and gbem_step()).
+ *
+ * A log file is "GBFH", a version byte, then a hash for each frame, as
+ * eight little endian bytes. Given a golden log to check against, the
+ * first frame that differs from it is reported. */
+
+#define FRAMEHASH_MAGIC		"GBFH"
+#define FRAMEHASH_VERSION	1
+
+typedef struct {
+	uint64_t *hash;				/* of each frame so far */
+	unsigned int count, capacity;
+	uint64_t *golden;			/* what they should be, or NULL */
+	unsigned int golden_count;
+	long diverged;				/* first frame unlike the golden log, or -1 */
+} FrameLog;
+
+uint64_t hash64(const void *data, size_t size);
+uint64_t frame_hash(const uint32_t *frame);
+
+/* a new log, checked against the golden log in golden_fn unless that is
+ * NULL. NULL if the golden log can't be read */
+FrameLog *framelog_new(const char *golden_fn);
+void framelog_free(FrameLog *log);
+void framelog_rewind(FrameLog *log);
+/* called by the display as each frame is finished */
+void framelog_add(FrameLog *log, const uint32_t *frame);
+int framelog_save(const FrameLog *log, const char *fn);
+/* a line on how the run compared with the golden log */
+void framelog_report(const FrameLog *log, FILE *fp);
+
+#endif /* _FRAMEHASH_H */
@@ -0,0 +1,253 @@
+/*
+ * idle.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "idle.h"
+#include "core.h"
+#include "memory.h"
+#include "sched.h"
+
+/* registers, as bits of the masks of what an instruction reads and
+ * writes. Index with the 3 bit register field of an opcode; 6 is (HL) */
+#define R_B		0x01
+#define R_C		0x02
+#define R_D		0x04
+#define R_E		0x08
+#define R_H		0x10
+#define R_L		0x20
+#define R_A		0x40
+#define R_F		0x80
+
+static const Byte reg_mask[8] = {
+	R_B, R_C, R_D, R_E, R_H, R_L, R_H | R_L, R_A
+};
+
+#define idle_pc			(gb_idle->pc)
+#define idle_time		(gb_idle->time)
+
+int idle_skipping = 1;
+
+static int idle_op(Byte op, Byte cb, unsigned int *use, unsigned int *def);
+
+void idle_flush(void) {
+	int i;
+	/* 0xFFFF is never a rom address, so it can't match a lookup */
+	for (i = 0; i < IDLE_CACHE_SIZE; i++)
+		idle_cache[i].pc = 0xFFFF;
+	idle_pc = 0xFFFF;
+}
+
+/*
+ * a loop is idle if it is a straight run of at most IDLE_MAX_OPS
+ * instructions ending in a jump back to pc, none of which write memory,
+ * and every register it writes is written before it is read. Every pass
+ * then works out the same values from the same inputs.
+ */
+void idle_decode(IdleLoop *l, Word pc, unsigned int bank) {
+	/* a loop never runs off the end of the bank it started in */
+	unsigned int end = (pc < MEM_ROM_BANK_SW) ? MEM_ROM_BANK_SW : MEM_VIDEO;
+	unsigned int address = pc;
+	unsigned int used = 0, written = 0, use, def;
+	int cycles = 0;
+	int i;
+
+	l->pc = pc;
+	l->bank = bank;
+	l->cycles = 0;
+
+	for (i = 0; i < IDLE_MAX_OPS; i++) {
+		Byte op = readb(address);
+		Word target;
+
+		if (address + op_length[op] > end)
+			return;
+
+		switch (op) {
+			case 0x18:	// JR n
+			case 0x20:	// JR NZ, n
+			case 0x28:	// JR Z, n
+			case 0x30:	// JR NC, n
+			case 0x38:	// JR C, n
+				target = address + 2 + (signed char)readb(address + 1);
+				cycles += 12;
+				break;
+			case 0xC3:	// JP nn
+			case 0xC2:	// JP NZ, nn
+			case 0xCA:	// JP Z, nn
+			case 0xD2:	// JP NC, nn
+			case 0xDA:	// JP C, nn
+				target = readw(address + 1);
+				cycles += 16;
+				break;
+			default:
+				if (!idle_op(op, readb(address + 1), &use, &def))
+					return;
+				used |= use & ~written;
+				written |= def;
+				cycles += (op == 0xCB) ? cb_cycles[readb(address + 1)]
+						: op_cycles[op];
+				address += op_length[op];
+				continue;
+		}
+
+		/* the conditional jumps read the flags */
+		if (op != 0x18 && op != 0xC3)
+			used |= R_F & ~written;
+		if (target == pc && (used & written) == 0)
+			l->cycles = cycles;
+		return;
+	}
+}
+
+/*
+ * the registers an instruction reads and writes, or 0 if it can't be part
+ * of an idle loop: it writes memory, changes SP or PC, or is anything else
+ * with a side effect
+ */
+static int idle_op(Byte op, Byte cb, unsigned int *use, unsigned int *def) {
+	unsigned int r = reg_mask[op & 7];
+	unsigned int d = reg_mask[(op >> 3) & 7];
+
+	/* LD r, r and LD r, (HL) */
+	if (op >= 0x40 && op < 0x80) {
+		if ((op & 0xF8) == 0x70)
+			return 0;	/* LD (HL), r and HALT */
+		*use = r;
+		*def = d;
+		return 1;
+	}
+	/* ADD, ADC, SUB, SBC, AND, XOR, OR, CP with A, and their imm forms */
+	if (op >= 0x80 || (op & 0xC7) == 0xC6) {
+		if (op >= 0xC0) {
+			if ((op & 0xC7) != 0xC6)
+				goto other;
+			r = 0;
+		}
+		if (op == 0x97 || op == 0xAF)
+			*use = 0;	/* SUB A and XOR A don't depend on A */
+		else
+			*use = R_A | r;
+		if (((op >> 3) & 7) == 1 || ((op >> 3) & 7) == 3)
+			*use |= R_F;	/* ADC and SBC */
+		*def = (((op >> 3) & 7) == 7) ? R_F : R_A | R_F;
+		return 1;
+	}
+	/* LD r, n */
+	if ((op & 0xC7) == 0x06 && op != 0x36) {
+		*use = 0;
+		*def = d;
+		return 1;
+	}
+	/* INC r and DEC r, which keep the carry flag */
+	if (((op & 0xC7) == 0x04 || (op & 0xC7) == 0x05) && d != (R_H | R_L)) {
+		*use = d | R_F;
+		*def = d | R_F;
+		return 1;
+	}
+
+other:
+	switch (op) {
+		case 0x00:	// NOP
+			*use = 0;
+			*def = 0;
+			return 1;
+		case 0x0A:	// LD A, (BC)
+			*use = R_B | R_C;
+			*def = R_A;
+			return 1;
+		case 0x1A:	// LD A, (DE)
+			*use = R_D | R_E;
+			*def = R_A;
+			return 1;
+		case 0xF0:	// LDH A, (n)
+		case 0xFA:	// LD A, (nn)
+			*use = 0;
+			*def = R_A;
+			return 1;
+		case 0xF2:	// LDH A, (C)
+			*use = R_C;
+			*def = R_A;
+			return 1;
+		case 0x2F:	// CPL
+			*use = R_A | R_F;
+			*def = R_A | R_F;
+			return 1;
+		case 0xCB:
+			r = reg_mask[cb & 7];
+			if (cb >= 0x40 && cb < 0x80) {
+				/* BIT b, r and BIT b, (HL), which keep the carry flag */
+				*use = r | R_F;
+				*def = R_F;
+				return 1;
+			}
+			if ((cb & 7) == 6)
+				return 0;	/* writes (HL) */
+			if (cb >= 0x80) {
+				/* RES b, r and SET b, r */
+				*use = r;
+				*def = r;
+				return 1;
+			}
+			/* rotates, shifts and SWAP; RL and RR read the carry */
+			*use = r | (((cb & 0xF0) == 0x10) ? R_F : 0);
+			*def = r | R_F;
+			return 1;
+	}
+	return 0;
+}
+
+/*
+ * the registers only hold the values every later pass would give them
+ * once a whole pass has run inside this time slice, so the first branch
+ * into a loop just records the time. After that, skip all the passes that
+ * fit in what is left of the slice but the last, which runs for real so
+ * the cpu ends the slice exactly where it would have.
+ */
+int idle_skip(const IdleLoop *l, int done, int left) {
+	uint64_t now = sched.now + done;
+	int passes;
+
+	if (idle_pc != l->pc || idle_time < sched.now ||
+			now - idle_time != (uint64_t)l->cycles) {
+		idle_pc = l->pc;
+		idle_time = now;
+		return 0;
+	}
+	/* an interrupt is about to be taken */
+	if (core.int_ready) {
+		idle_time = now;
+		return 0;
+	}
+	passes = left / l->cycles - 1;
+	if (passes < 0)
+		passes = 0;
+	idle_time = now + passes * l->cycles;
+	return passes * l->cycles;
+}
@@ -0,0 +1,100 @@
+/*
+ * idle.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _IDLE_H
+#define _IDLE_H
+
+#include "gbem.h"
+#include "block.h"
+
+/* idle loops: short runs of rom code like
+ *     loop: ldh a,(44h) / cp 90h / jr nz,loop
+ * that only read memory and keep jumping back to their start. Nothing the
+ * loop reads can change during one call of execute_cycles (the display
+ * and other devices only move on between calls, see sched.c; DIV and TIMA
+ * do count up, but reading them calls idle_break()), so once the cpu has
+ * been round such a loop once, every pass after it is the same and the
+ * core can skip straight to the end of the time slice.
+ * Loops are recognised by idle_decode() and the result is cached per
+ * start address and rom bank. */
+
+#define IDLE_MAX_OPS		8
+#define IDLE_CACHE_SIZE		256		/* must be a power of two */
+
+typedef struct {
+	Word pc;
+	unsigned int bank;	/* rom bank and block the code was decoded from */
+	int cycles;			/* of one pass, 0 if pc doesn't start an idle loop */
+} IdleLoop;
+
+typedef struct {
+	IdleLoop cache[IDLE_CACHE_SIZE];
+	/* where and when the last branch into a loop was taken */
+	Word pc;
+	uint64_t time;
+} IdleState;
+
+/* the idle loops found by the selected instance, see instance.h */
+extern __thread IdleState *gb_idle;
+#define idle_cache		(gb_idle->cache)
+
+/* clear this to run idle loops instruction by instruction */
+extern int idle_skipping;
+
+void idle_flush(void);
+void idle_decode(IdleLoop *l, Word pc, unsigned int bank);
+int idle_skip(const IdleLoop *l, int done, int left);
+
+static inline int idle_check(Word pc, int done, int left);
+static inline void idle_break(void);
+
+/* called when a branch to pc has been taken, done cycles into a time slice
+ * with left cycles still to run. Returns the number of cycles skipped, a
+ * whole number of passes round the loop */
+static inline int idle_check(Word pc, int done, int left) {
+	unsigned int bank = block_bank(pc);
+	IdleLoop *l;
+
+	l = &idle_cache[(pc ^ (bank << 4)) & (IDLE_CACHE_SIZE - 1)];
+	if (l->pc != pc || l->bank != bank)
+		idle_decode(l, pc, bank);
+	if (l->cycles == 0)
+		return 0;
+	return idle_skip(l, done, left);
+}
+
+/* the loop being run read something that changes as the cpu runs, so
+ * don't skip it */
+static inline void idle_break(void) {
+	gb_idle->pc = 0xFFFF;
+}
+
+#endif	//_IDLE_H
@@ -0,0 +1,102 @@
+/*
+ * instance.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "instance.h"
+
+__thread GbInstance *gb;
+
+__thread CoreState *gb_core;
+__thread MemoryState *gb_memory;
+__thread Cart *gb_cart;
+__thread Rtc *gb_rtc;
+__thread Display *gb_display;
+__thread Scheduler *gb_sched;
+__thread Timer *gb_timer;
+__thread SoundData *gb_sound;
+__thread BlockCache *gb_blocks;
+__thread IdleState *gb_idle;
+__thread Serial *gb_serial;
+__thread Joypad *gb_joypad;
+
+/* a new instance, all zero but for what can't start that way. It still
+ * has to be selected and then set up like a fresh process would be:
+ * load_rom() and a reset */
+GbInstance *gb_new(void) {
+	GbInstance *g = calloc(1, sizeof(GbInstance));
+
+	if (g == NULL) {
+		fprintf(stderr, "couldn't allocate an emulator instance\n");
+		exit(1);
+	}
+	g->serial_state.sockfd = -1;
+	return g;
+}
+
+/* after the instance's rom has been unloaded and memory_fini() called */
+void gb_free(GbInstance *g) {
+	if (g == gb)
+		gb_select(NULL);
+	free(g);
+}
+
+void gb_select(GbInstance *g) {
+	gb = g;
+	if (g == NULL) {
+		gb_core = NULL;
+		gb_memory = NULL;
+		gb_cart = NULL;
+		gb_rtc = NULL;
+		gb_display = NULL;
+		gb_sched = NULL;
+		gb_timer = NULL;
+		gb_sound = NULL;
+		gb_blocks = NULL;
+		gb_idle = NULL;
+		gb_serial = NULL;
+		gb_joypad = NULL;
+		return;
+	}
+	gb_core = &g->core_state;
+	gb_memory = &g->memory_state;
+	gb_cart = &g->cart_state;
+	gb_rtc = &g->rtc_state;
+	gb_display = &g->display_state;
+	gb_sched = &g->sched_state;
+	gb_timer = &g->timer_state;
+	gb_sound = &g->sound_state;
+	gb_blocks = &g->block_state;
+	gb_idle = &g->idle_state;
+	gb_serial = &g->serial_state;
+	gb_joypad = &g->joypad_state;
+}
@@ -0,0 +1,79 @@
+/*
+ * instance.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _INSTANCE_H
+#define _INSTANCE_H
+
+#include "gbem.h"
+#include "core.h"
+#include "memory.h"
+#include "cart.h"
+#include "display.h"
+#include "sched.h"
+#include "timer.h"
+#include "sound.h"
+#include "block.h"
+#include "idle.h"
+#include "serial2sock.h"
+#include "joypad.h"
+
+/* everything one emulated game boy needs. The code for each part works on
+ * the instance selected by gb_select() in the calling thread, through the
+ * gb_core, gb_memory, ... pointers declared next to each part's state, so
+ * several instances can run at once as long as each one stays in its own
+ * thread. What is left global is either read only once set up (the alu and
+ * lfsr tables, key bindings) or belongs to the process (the audio device,
+ * the debugger, the save file being read or written). */
+
+typedef struct GbInstance {
+	CoreState core_state;
+	MemoryState memory_state;
+	Cart cart_state;
+	Rtc rtc_state;
+	Display display_state;
+	Scheduler sched_state;
+	Timer timer_state;
+	SoundData sound_state;
+	BlockCache block_state;
+	IdleState idle_state;
+	Serial serial_state;
+	Joypad joypad_state;
+	struct Observation *observation;	/* for gbem_step(), see libgbem.c */
+} GbInstance;
+
+/* the instance selected in this thread */
+extern __thread GbInstance *gb;
+
+GbInstance *gb_new(void);
+void gb_free(GbInstance *g);
+void gb_select(GbInstance *g);
+
+#endif	//_INSTANCE_H
@@ -24,68 +24,51 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <SDL/SDL.h>
 #include "joypad.h"
 #include "memory.h"
 #include "core.h"
 
-static SDLKey key_binds[8];
-static int is_pressed[8];
+#define is_pressed		(gb_joypad->is_pressed)
 
 
 void joypad_init(void) {
 	int i;
-	// defaults
-	key_binds[BUTTON_RIGHT] 	= SDLK_RIGHT;
-	key_binds[BUTTON_LEFT] 		= SDLK_LEFT;
-	key_binds[BUTTON_UP] 		= SDLK_UP;
-	key_binds[BUTTON_DOWN] 		= SDLK_DOWN;
-	key_binds[BUTTON_A] 		= SDLK_x;
-	key_binds[BUTTON_B] 		= SDLK_y;
-	key_binds[BUTTON_SELECT]	= SDLK_TAB;
-	key_binds[BUTTON_START]		= SDLK_SPACE;
-
 	for (i = 0; i < NUM_BUTTONS; i++) {
 		is_pressed[i] = 0;
 	}
 	
 }
 
-void key_event(SDL_KeyboardEvent* event) {
-	int i;
-	for (i = 0; i < NUM_BUTTONS; i++) {
-		if (event->keysym.sym == key_binds[i]) {
-			if (event->type == SDL_KEYDOWN)
-				is_pressed[i] = 1;
-			else
-				is_pressed[i] = 0;
-		}
-	}
+/* called by the backend when a button is pressed or let go */
+void joypad_event(int button, int pressed) {
+	is_pressed[button] = pressed;
 }
 
+/* record the buttons the game polls from now on into m, or play them back
+ * from it, depending on its mode. NULL stops either. The movie still
+ * belongs to the caller */
+void joypad_movie(Movie *m) {
+	gb_joypad->movie = m;
+}
+
+/* the game writes P1 to choose which buttons to read, then reads them */
 void update_p1(void) {
 	Byte p1 = read_io(HWREG_P1) | 0x0F;		// set all buttons as unpressed
+	unsigned int buttons = 0;
+	int i;
+
+	for (i = 0; i < NUM_BUTTONS; i++) {
+		if (is_pressed[i])
+			buttons |= 1 << i;
+	}
+	if (gb_joypad->movie != NULL)
+		buttons = movie_poll(gb_joypad->movie, buttons);
+
 	// a 0 bit represents a button being pressed.
 	// the following code unsets appropriate bits.
-	if ((p1 & 0x10) == 0) {			// p14 (direction buttons)
-		if (is_pressed[BUTTON_RIGHT])
-			p1 &= ~0x01;
-		if (is_pressed[BUTTON_LEFT])
-			p1 &= ~0x02;
-		if (is_pressed[BUTTON_UP])
-			p1 &= ~0x04;
-		if (is_pressed[BUTTON_DOWN])
-			p1 &= ~0x08;
-	}
-	if ((p1 & 0x20) == 0) {			// p15 (other buttons)
-		if (is_pressed[BUTTON_A])
-			p1 &= ~0x01;
-		if (is_pressed[BUTTON_B])
-			p1 &= ~0x02;
-		if (is_pressed[BUTTON_SELECT])
-			p1 &= ~0x04;
-		if (is_pressed[BUTTON_START])
-			p1 &= ~0x08;
-	}
+	if ((p1 & 0x10) == 0)			// p14 (direction buttons)
+		p1 &= ~(buttons & 0x0F);
+	if ((p1 & 0x20) == 0)			// p15 (other buttons)
+		p1 &= ~(buttons >> 4);
 	write_io(HWREG_P1, p1);
 }
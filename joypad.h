@@ -27,7 +27,7 @@
 #ifndef _JOYPAD_H
 #define _JOYPAD_H
 
-#include <SDL/SDL.h>
+#include "movie.h"
 
 #define BUTTON_RIGHT		0
 #define BUTTON_LEFT			1
@@ -39,8 +39,17 @@
 #define BUTTON_START		7
 #define NUM_BUTTONS			8
 
+typedef struct {
+	int is_pressed[NUM_BUTTONS];
+	Movie *movie;			/* recording or playing back, see movie.h */
+} Joypad;
+
+/* the buttons of the selected instance, see instance.h */
+extern __thread Joypad *gb_joypad;
+
 void joypad_init();
-void key_event(SDL_KeyboardEvent* event);
+void joypad_event(int button, int pressed);
+void joypad_movie(Movie *m);
 void update_p1();
 
 #endif	//_JOYPAD_H
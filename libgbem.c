@@ -0,0 +1,355 @@
+/*
+ * libgbem.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "libgbem.h"
+#include "instance.h"
+#include "sched.h"
+#include "movie.h"
+#include "framehash.h"
+
+/* what gbem_step() returns, see gbem_observe() */
+typedef struct Observation {
+	unsigned int format;
+	unsigned int scale;
+	Word address;
+	unsigned int length;
+	void *obs;					/* the shrunk frame, unless scale is 1 */
+	Byte *ram;
+} Observation;
+
+/* a new instance, selected, with no rom yet */
+GbInstance *gbem_new(void) {
+	GbInstance *g = gb_new();
+
+	gb_select(g);
+	console = CONSOLE_AUTO;
+	return g;
+}
+
+void gbem_free(GbInstance *g) {
+	gbem_movie_stop(g);
+	gbem_hash_stop(g);
+	if (g->observation != NULL) {
+		free(g->observation->obs);
+		free(g->observation->ram);
+		free(g->observation);
+	}
+	if (cart.is_loaded) {
+		sound_fini();
+		unload_rom();
+		display_fini();
+	}
+	memory_fini();
+	gb_free(g);
+}
+
+/* the rest of the machine depends on the cart, so is set up once it is
+ * loaded */
+static int setup(void) {
+	display_init();
+	joypad_init();
+	sound_init();
+	gbem_reset(gb);
+	return 0;
+}
+
+int gbem_load_rom(GbInstance *g, const void *data, unsigned int size) {
+	gb_select(g);
+	if (load_rom_buffer(data, size) != 0)
+		return -1;
+	return setup();
+}
+
+int gbem_load_rom_shared(GbInstance *g, const void *data, unsigned int size) {
+	gb_select(g);
+	if (load_rom_shared(data, size) != 0)
+		return -1;
+	return setup();
+}
+
+int gbem_load_rom_file(GbInstance *g, const char *fn) {
+	gb_select(g);
+	if (load_rom(fn) != 0)
+		return -1;
+	return setup();
+}
+
+void gbem_reset(GbInstance *g) {
+	gb_select(g);
+	/* finish the frame being drawn, before its state goes */
+	display_flush();
+	// the order in which these are called is important
+	sched_reset();
+	memory_reset();
+	cart_reset();
+	core_reset();
+	display_reset();
+	timer_reset();
+	sound_reset();
+	if (gb_joypad->movie != NULL)
+		movie_rewind(gb_joypad->movie);
+	if (display.hashes != NULL)
+		framelog_rewind(display.hashes);
+}
+
+unsigned int gbem_run_frame(GbInstance *g) {
+	unsigned int frames;
+	unsigned int cycles = 0;
+
+	gb_select(g);
+	sound_discard();
+	frames = display.frames;
+	/* the display stops the run at the start of vblank */
+	while (display.frames == frames && cycles < GB_FRAME_CYCLES)
+		cycles += sched_run(GB_FRAME_CYCLES - cycles);
+	/* a run that stopped short of vblank, as when the lcd was turned on
+	 * partway through, has lines still to draw */
+	display_flush();
+	sound_update();
+	return cycles;
+}
+
+void gbem_set_buttons(GbInstance *g, unsigned int buttons) {
+	int i;
+
+	gb_select(g);
+	for (i = 0; i < NUM_BUTTONS; i++)
+		joypad_event(i, (buttons >> i) & 1);
+}
+
+const uint32_t *gbem_frame(GbInstance *g) {
+	return g->display_state.frame;
+}
+
+int gbem_observe(GbInstance *g, unsigned int format, unsigned int scale,
+                 uint16_t address, unsigned int length) {
+	Observation *o;
+
+	if (format > GBEM_OBS_SHADES || scale == 0 || scale > 16 ||
+	    (scale & (scale - 1)) != 0 || address + length > 0x10000)
+		return -1;
+	o = g->observation;
+	if (o == NULL)
+		o = g->observation = calloc(1, sizeof(Observation));
+	o->format = format;
+	o->scale = scale;
+	o->address = address;
+	o->length = length;
+	free(o->obs);
+	free(o->ram);
+	o->obs = NULL;
+	if (scale > 1)
+		o->obs = malloc((GBEM_FRAME_W / scale) * (GBEM_FRAME_H / scale) *
+		                (format == GBEM_OBS_RGB ? sizeof(uint32_t) : 1));
+	o->ram = malloc(length > 0 ? length : 1);
+	return 0;
+}
+
+/* box filter the frame down by o->scale */
+static void shrink_rgb(const Observation *o, const uint32_t *frame) {
+	unsigned int w = GBEM_FRAME_W / o->scale, h = GBEM_FRAME_H / o->scale;
+	unsigned int n = o->scale * o->scale;
+	uint32_t *out = o->obs;
+	unsigned int x, y, i, j, r, gr, b;
+	const uint32_t *p;
+
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			r = gr = b = 0;
+			for (j = 0; j < o->scale; j++) {
+				p = frame + (y * o->scale + j) * GBEM_FRAME_W + x * o->scale;
+				for (i = 0; i < o->scale; i++) {
+					r += (p[i] >> 16) & 0xFF;
+					gr += (p[i] >> 8) & 0xFF;
+					b += p[i] & 0xFF;
+				}
+			}
+			out[y * w + x] = ((r / n) << 16) | ((gr / n) << 8) | (b / n);
+		}
+	}
+}
+
+static void shrink_shades(const Observation *o, const Byte *shades) {
+	unsigned int w = GBEM_FRAME_W / o->scale, h = GBEM_FRAME_H / o->scale;
+	unsigned int n = o->scale * o->scale;
+	Byte *out = o->obs;
+	unsigned int x, y, i, j, sum;
+	const Byte *p;
+
+	for (y = 0; y < h; y++) {
+		for (x = 0; x < w; x++) {
+			sum = 0;
+			for (j = 0; j < o->scale; j++) {
+				p = shades + (y * o->scale + j) * GBEM_FRAME_W + x * o->scale;
+				for (i = 0; i < o->scale; i++)
+					sum += p[i];
+			}
+			out[y * w + x] = (sum + n / 2) / n;
+		}
+	}
+}
+
+unsigned int gbem_step(GbInstance *g, unsigned int buttons,
+                       unsigned int frameskip, const void **obs,
+                       const uint8_t **ram) {
+	Observation *o = g->observation;
+	unsigned int cycles = 0, f, i;
+
+	if (o == NULL) {
+		gbem_observe(g, GBEM_OBS_RGB, 1, 0, 0);
+		o = g->observation;
+	}
+	gbem_set_buttons(g, buttons);
+	/* only the last frame is seen, so the rest needn't be drawn at all */
+	display.draw_mode = o->format == GBEM_OBS_SHADES ? DRAW_SHADES : DRAW_RGB;
+	for (f = 0; f + 1 < frameskip; f++) {
+		display_skip(1);
+		cycles += gbem_run_frame(g);
+	}
+	display_skip(0);
+	cycles += gbem_run_frame(g);
+	display.draw_mode = DRAW_RGB;
+
+	if (o->format == GBEM_OBS_SHADES) {
+		*obs = display.shades;
+		if (o->scale > 1)
+			shrink_shades(o, display.shades);
+	} else {
+		*obs = display.frame;
+		if (o->scale > 1)
+			shrink_rgb(o, display.frame);
+	}
+	if (o->scale > 1)
+		*obs = o->obs;
+	for (i = 0; i < o->length; i++)
+		o->ram[i] = readb(o->address + i);
+	*ram = o->ram;
+	return cycles;
+}
+
+const short *gbem_audio(GbInstance *g, int *count) {
+	gb_select(g);
+	return sound_peek(count);
+}
+
+uint8_t gbem_peek(GbInstance *g, uint16_t address) {
+	gb_select(g);
+	return readb(address);
+}
+
+const uint8_t *gbem_sram(GbInstance *g, unsigned int *size) {
+	gb_select(g);
+	if (cart.ram_size == 0) {
+		*size = 0;
+		return NULL;
+	}
+	*size = cart.ram_size;
+	return cart.ram;
+}
+
+static int start_movie(Movie *m) {
+	if (m == NULL)
+		return -1;
+	movie_free(gb_joypad->movie);
+	joypad_movie(m);
+	return 0;
+}
+
+int gbem_movie_record(GbInstance *g) {
+	gb_select(g);
+	return start_movie(movie_record());
+}
+
+int gbem_movie_play(GbInstance *g, const void *data, unsigned int size) {
+	gb_select(g);
+	return start_movie(movie_from_buffer(data, size));
+}
+
+int gbem_movie_play_file(GbInstance *g, const char *fn) {
+	gb_select(g);
+	return start_movie(movie_load(fn));
+}
+
+int gbem_movie_save(GbInstance *g, const char *fn) {
+	gb_select(g);
+	if (gb_joypad->movie == NULL || gb_joypad->movie->mode != MOVIE_RECORD)
+		return -1;
+	return movie_save(gb_joypad->movie, fn);
+}
+
+int gbem_movie_done(GbInstance *g) {
+	return g->joypad_state.movie != NULL && g->joypad_state.movie->is_done;
+}
+
+void gbem_movie_stop(GbInstance *g) {
+	gb_select(g);
+	movie_free(gb_joypad->movie);
+	joypad_movie(NULL);
+}
+
+uint64_t gbem_frame_hash(GbInstance *g) {
+	return frame_hash(g->display_state.frame);
+}
+
+int gbem_hash_start(GbInstance *g, const char *golden_fn) {
+	FrameLog *log = framelog_new(golden_fn);
+
+	if (log == NULL)
+		return -1;
+	gbem_hash_stop(g);
+	g->display_state.hashes = log;
+	return 0;
+}
+
+int gbem_hash_save(GbInstance *g, const char *fn) {
+	if (g->display_state.hashes == NULL)
+		return -1;
+	return framelog_save(g->display_state.hashes, fn);
+}
+
+long gbem_hash_diverged(GbInstance *g) {
+	if (g->display_state.hashes == NULL)
+		return -1;
+	return g->display_state.hashes->diverged;
+}
+
+void gbem_hash_report(GbInstance *g, FILE *fp) {
+	if (g->display_state.hashes != NULL)
+		framelog_report(g->display_state.hashes, fp);
+}
+
+void gbem_hash_stop(GbInstance *g) {
+	framelog_free(g->display_state.hashes);
+	g->display_state.hashes = NULL;
+}
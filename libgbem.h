@@ -0,0 +1,139 @@
+/*
+ * libgbem.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _LIBGBEM_H
+#define _LIBGBEM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* gbem as a library: everything a program embedding the emulator needs,
+ * without the window, event loop or audio device of the front end. Build
+ * with the null backend (see backend.h) and none of sdl is touched.
+ *
+ * There is no separate library target: compile every source but main.c
+ * and backend_sdl.c with GBEM_NO_SDL defined and link the objects into
+ * the embedding program, or archive them with ar.
+ *
+ * Each instance runs in whichever thread calls these, and must not be
+ * used from two threads at once. The calls select the instance they are
+ * given (see instance.h), so instances can be mixed freely in a thread. */
+
+struct GbInstance;
+
+/* buttons for gbem_set_buttons(), in the order of joypad.h */
+#define GBEM_RIGHT			0x01
+#define GBEM_LEFT			0x02
+#define GBEM_UP				0x04
+#define GBEM_DOWN			0x08
+#define GBEM_A				0x10
+#define GBEM_B				0x20
+#define GBEM_SELECT			0x40
+#define GBEM_START			0x80
+
+#define GBEM_FRAME_W		160
+#define GBEM_FRAME_H		144
+
+/* observations for gbem_step() */
+#define GBEM_OBS_RGB		0		/* 0x00RRGGBB pixels, as gbem_frame() */
+#define GBEM_OBS_SHADES		1		/* a byte a pixel, 0 (white) to 3 */
+
+struct GbInstance *gbem_new(void);
+void gbem_free(struct GbInstance *g);
+
+/* all return 0 on success. A rom loaded from memory is copied, and has no
+ * sram file; one loaded from a file keeps its sram next to it. A shared
+ * rom isn't copied, so many instances can run one image: it must stay put
+ * and unchanged until they are freed */
+int gbem_load_rom(struct GbInstance *g, const void *data, unsigned int size);
+int gbem_load_rom_shared(struct GbInstance *g, const void *data,
+                         unsigned int size);
+int gbem_load_rom_file(struct GbInstance *g, const char *fn);
+void gbem_reset(struct GbInstance *g);
+
+/* run until the lcd finishes a frame, or a frame's worth of cycles if it
+ * is off. Returns the cycles run */
+unsigned int gbem_run_frame(struct GbInstance *g);
+void gbem_set_buttons(struct GbInstance *g, unsigned int buttons);
+
+/* GBEM_FRAME_W * GBEM_FRAME_H pixels, 0x00RRGGBB, as the emulator drew
+ * them. Valid until the next gbem_run_frame() */
+const uint32_t *gbem_frame(struct GbInstance *g);
+/* for training loops: what gbem_step() returns. The frame in the given
+ * format, shrunk by scale each way (1, 2, 4, 8 or 16) with each pixel the
+ * average of those it covers, and length bytes of memory from address on,
+ * say where the game keeps its score. Returns 0 if they are good */
+int gbem_observe(struct GbInstance *g, unsigned int format, unsigned int scale,
+                 uint16_t address, unsigned int length);
+/* hold the buttons for frameskip frames (at least one), drawing only the
+ * last of them, and set obs to its GBEM_FRAME_W / scale by GBEM_FRAME_H /
+ * scale pixels and ram to the bytes asked for. Both are valid until the
+ * next call. The frames skipped aren't drawn at all, so gbem_frame() and
+ * frame hashes don't follow them. Returns the cycles run */
+unsigned int gbem_step(struct GbInstance *g, unsigned int buttons,
+                       unsigned int frameskip, const void **obs,
+                       const uint8_t **ram);
+/* the interleaved stereo samples of the last frame run, at 44100Hz. None
+ * if the instance is played by the backend's audio device. Valid until
+ * the next gbem_run_frame() */
+const short *gbem_audio(struct GbInstance *g, int *count);
+/* input movies (see movie.h), started after loading the rom so they cover
+ * the run from the start. A reset restarts them too. Recording takes the
+ * buttons given by gbem_set_buttons(); playing back overrides them until
+ * the movie ends */
+int gbem_movie_record(struct GbInstance *g);
+int gbem_movie_play(struct GbInstance *g, const void *data, unsigned int size);
+int gbem_movie_play_file(struct GbInstance *g, const char *fn);
+int gbem_movie_save(struct GbInstance *g, const char *fn);
+/* non zero once a movie has played to the end */
+int gbem_movie_done(struct GbInstance *g);
+void gbem_movie_stop(struct GbInstance *g);
+
+/* frame hashes (see framehash.h): the xxh64 of the frame as it is now,
+ * and a log of the hash of each frame the lcd finishes, started after
+ * loading the rom. Given a golden log, the first frame to differ from it
+ * is reported on stderr. A reset starts the log again */
+uint64_t gbem_frame_hash(struct GbInstance *g);
+int gbem_hash_start(struct GbInstance *g, const char *golden_fn);
+int gbem_hash_save(struct GbInstance *g, const char *fn);
+/* the first frame unlike the golden log's, or -1 */
+long gbem_hash_diverged(struct GbInstance *g);
+void gbem_hash_report(struct GbInstance *g, FILE *fp);
+void gbem_hash_stop(struct GbInstance *g);
+
+/* a byte of the address space, as the cpu would read it */
+uint8_t gbem_peek(struct GbInstance *g, uint16_t address);
+
+/* the cart's ram, as it would be saved to an sram file. NULL if it has
+ * none */
+const uint8_t *gbem_sram(struct GbInstance *g, unsigned int *size);
+
+#endif	//_LIBGBEM_H
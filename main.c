@@ -30,61 +30,83 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <signal.h>
 #include <stdio.h>
-
-#include <SDL/SDL.h>
+#include <stdlib.h>
+#include <string.h>
 #include <locale.h>
 
 #include "config.h"
 
-#include "memory.h"
 #include "core.h"
-#include "cart.h"
-#include "timer.h"
+#include "idle.h"
 #include "display.h"
-#include "joypad.h"
 #include "sound.h"
 #include "debug.h"
 #include "save.h"
 #include "serial2sock.h"
+#include "bench.h"
+#include "batch.h"
+#include "forkserver.h"
+#include "profile.h"
+#include "instance.h"
+#include "backend.h"
+#include "libgbem.h"
 
-#define TIMING_GRANULARITY	10000
-#define TIMING_INTERVAL		(1000000000 / TIMING_GRANULARITY)
-#define MAX_CPU_CYCLES		200
-
-int console;
-int console_mode;
-
-extern CoreState core;
+/* microseconds the lcd takes to draw a frame */
+#define FRAME_US		((GB_FRAME_CYCLES * 1000000ULL) / 4194304)
 
-void reset(void);
 void quit(void);
 extern int debugging;
-extern int sound_cycles;
 
+static GbInstance *game;
+static const char *record_fn;		/* where the movie being recorded goes */
+static const char *hash_fn;			/* and the frame hashes */
+static int is_hashing;
+static const char *profile_fn;		/* prefix of the profile's files */
+static unsigned long frame_limit;	/* stop after this many frames, 0 for never */
+static volatile sig_atomic_t is_quitting;	/* set by SIGINT or SIGTERM */
 
+/* let the main loop finish the frame and quit() properly, so movies,
+ * hashes and profiles still get written */
+static void on_signal(int sig) {
+	(void)sig;
+	is_quitting = 1;
+}
 
 int main(int argc, char *argv[]) {
-	int i;
 	unsigned int is_paused, is_sound_on;
-	unsigned int cycles;
-	unsigned int core_period;
-	SDL_Event event;
-	unsigned int core_time;
-	unsigned int delay;
-	int is_delayed;
-	unsigned int real_time;
-	unsigned int real_time_passed;
-	unsigned int delays;
-	unsigned int frame_time;
+	unsigned int actions;
+	unsigned long long now, due;
 	int is_turbo = 0;
+	unsigned long frames = 0;
+	const char *play_fn = NULL;
+	const char *golden_fn = NULL;
 
 	printf("%s v%s\n", PACKAGE_NAME, PACKAGE_VERSION);
 	if (argc < 2) {
 		printf("Invalid arguments\n");
-		printf("%s game.gb [-l port] [-c ipaddress port]\n");
+		printf("%s game.gb [-l port] [-c ipaddress port] [-i] [-break addr] [-watch addr] [-headless] [-record movie] [-play movie] [-hashlog file] [-hashcheck golden] [-profile prefix] [-frames n]\n", argv[0]);
+		printf("%s -b test [seconds]\n", argv[0]);
+		printf("%s -batch manifest [report.csv [threads]]\n", argv[0]);
+		printf("%s -forkserver rom socket [frames [movie]]\n", argv[0]);
 		return 1;
 	}
+	if (strcmp(argv[1], "-b") == 0) {
+		gb_select(gb_new());
+		return bench_main(argc, argv);
+	}
+	if (strcmp(argv[1], "-batch") == 0)
+		return batch_main(argc, argv);
+	if (strcmp(argv[1], "-forkserver") == 0)
+		return forkserver_main(argc, argv);
+
+#ifdef GBEM_NO_SDL
+	backend = &backend_null;
+#else
+	backend = &backend_sdl;
+#endif
+	game = gbem_new();
 
 	//parse arguments:
 	for(int i=2; i<argc; i++) {
@@ -105,150 +127,184 @@ int main(int argc, char *argv[]) {
 				serial_connect(argv[i-1], atoi(argv[i]));
 			}
 		}
+		/* no window, sound or input, and run flat out */
+		if (strcmp(argv[i], "-headless") == 0 || strcmp(argv[i], "--headless") == 0)
+			backend = &backend_null;
+		/* input movies, see movie.h */
+		if (strcmp(argv[i], "-record") == 0 || strcmp(argv[i], "-play") == 0) {
+			if (argc - i < 2) {
+				printf("%s needs additional arguments!", argv[i]);
+			} else {
+				i++;
+				if (argv[i - 1][1] == 'r')
+					record_fn = argv[i];
+				else
+					play_fn = argv[i];
+			}
+		}
+		/* frame hashes, see framehash.h */
+		if (strcmp(argv[i], "-hashlog") == 0 || strcmp(argv[i], "-hashcheck") == 0) {
+			if (argc - i < 2) {
+				printf("%s needs additional arguments!", argv[i]);
+			} else {
+				i++;
+				if (argv[i - 1][5] == 'l')
+					hash_fn = argv[i];
+				else
+					golden_fn = argv[i];
+				is_hashing = 1;
+			}
+		}
+		/* the instruction profiler, see profile.h */
+		if (strcmp(argv[i], "-profile") == 0) {
+			if (argc - i < 2) {
+				printf("%s needs additional arguments!", argv[i]);
+			} else {
+				i++;
+				profile_fn = argv[i];
+			}
+		}
+		/* run this many frames and quit */
+		if (strcmp(argv[i], "-frames") == 0) {
+			if (argc - i < 2) {
+				printf("%s needs additional arguments!", argv[i]);
+			} else {
+				i++;
+				frame_limit = strtoul(argv[i], NULL, 10);
+			}
+		}
+		/* run idle loops instruction by instruction, for accuracy tests */
+		if (strcmp(argv[i], "-i") == 0)
+			idle_skipping = 0;
+		/* breakpoints and watchpoints, addresses in hex */
+		if (strcmp(argv[i], "-break") == 0 || strcmp(argv[i], "-watch") == 0) {
+			if (argc - i < 2) {
+				printf("%s needs additional arguments!", argv[i]);
+			} else {
+				i++;
+				if (argv[i - 1][1] == 'b')
+					debug_add_breakpoint(strtol(argv[i], NULL, 16));
+				else
+					debug_add_watchpoint(strtol(argv[i], NULL, 16));
+			}
+		}
 	}
+	/* the core only checks breakpoints in its debugging version */
+	core_debug(0);
+	if (profile_fn != NULL)
+		core_profile(1);
 
-	if(SDL_Init(SDL_INIT_VIDEO) < 0) {
-		fprintf(stderr,"sdl initialisation failed: %s\b", SDL_GetError());
-		exit(1);
-	}
+	backend->init();
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
 
 //	freopen("CON", "w", stdout); // redirects stdout
 //	freopen("CON", "w", stderr); // redirects stderr
 
-	memory_init();
-	console = CONSOLE_AUTO;
-
 	//console = CONSOLE_DMG;
 	//console_mode = MODE_DMG;
-	load_rom(argv[1]);
-	display_init();
-	joypad_init();
-	sound_init();
+	if (gbem_load_rom_file(game, argv[1]) != 0)
+		goto failed;
+	if (record_fn != NULL)
+		gbem_movie_record(game);
+	if (play_fn != NULL && gbem_movie_play_file(game, play_fn) != 0)
+		goto failed;
+	if (is_hashing && gbem_hash_start(game, golden_fn) != 0)
+		goto failed;
 	debug_init();
-	reset();
 	is_paused = 0;
 	is_sound_on = 1;
-	cycles = 0;
-	core_time = 0;
-	delay = 1;
-	is_delayed = 0;
-	real_time = SDL_GetTicks() * 1000000;
-	delays = 0;
-	frame_time = SDL_GetTicks();
+	due = 0;
+	if (backend->ticks != NULL)
+		due = backend->ticks() * 1000ULL;
 	// main loop
-	// TODO intelligent algorithm for working out number of cycles to execute
-	// based on interrupt predictions...
-	
 	while(1) {
-		if ((!is_paused) && (!is_delayed)) {
-			for (i = 0; i < 10; i++) {
-				cycles = execute_cycles(40);
-
-				core_period = (cycles >> 2) * (1000000000/(1048576));
-				core_time += core_period;
-				timer_check(cycles * core.frequency);
-				display_update(cycles);
-				sound_update();
-//		        serial_txrx();
-			}
+		actions = backend->poll();
+		if ((actions & BACKEND_QUIT) || is_quitting)
+			break;
+		if (actions & BACKEND_DEBUG) {
+			printf("d\n");
+			core_debug(!debugging);
 		}
-		
-		if (is_paused) 
-			SDL_Delay(10);
+		if (actions & BACKEND_PAUSE) {
+			is_paused = !is_paused;
+			if (is_paused)
+				stop_sound();
+			else
+				start_sound();
+		}
+		if (actions & BACKEND_SOUND) {
+			is_sound_on = !is_sound_on;
+			if (is_sound_on)
+				start_sound();
+			else
+				stop_sound();
+		}
+		if (actions & BACKEND_RESET) {
+			printf("reset\n");
+			gbem_reset(game);
+		}
+		if (actions & BACKEND_SAVE)
+			save_state();
+		if (actions & BACKEND_LOAD)
+			load_state();
+		if (actions & BACKEND_TURBO_ON)
+			is_turbo = 1;
+		if (actions & BACKEND_TURBO_OFF)
+			is_turbo = 0;
 
-		delays = core_time / TIMING_INTERVAL;
-		if (delays > delay) {
-			real_time_passed = ((SDL_GetTicks() * 1000000) - real_time);
-			if ((core_time > real_time_passed) && (!is_turbo)) {
-				if (core_time > real_time_passed + (2 * 1000000))
-					SDL_Delay(1);
-				is_delayed = 1;
-			} else {
-				delay = delays;
-				is_delayed = 0;
-			}
-			if (delay >= TIMING_GRANULARITY) {
-				delay = 1;
-				core_time = 0;
-				real_time = SDL_GetTicks() * 1000000;
-			}
+		if (!is_paused) {
+			gbem_run_frame(game);
+			backend->present(gbem_frame(game));
+			if (frame_limit != 0 && ++frames >= frame_limit)
+				break;
 		}
+		/* with no one to take over, a headless run ends with its movie */
+		if (backend == &backend_null && play_fn != NULL &&
+				gbem_movie_done(game))
+			break;
 
-		while (SDL_PollEvent(&event)) {
-			switch (event.type) {
-				case SDL_QUIT:
-					quit();
-					exit(0);
-					break;
-				case SDL_KEYDOWN:
-					if (event.key.keysym.sym == SDLK_d) {
-						printf("d\n");
-						debugging = !debugging;
-					}
-					if (event.key.keysym.sym == SDLK_p) {
-						is_paused = !is_paused;
-						if (is_paused)
-							stop_sound();
-						else
-							start_sound();
-					}
-					if (event.key.keysym.sym == SDLK_s) {
-						is_sound_on = !is_sound_on;
-						if (is_sound_on)
-							start_sound();
-						else
-							stop_sound();
-					}
-					if (event.key.keysym.sym == SDLK_r) {
-						printf("reset\n");
-						reset();
-					}
-					if (event.key.keysym.sym == SDLK_F1) {
-						save_state();
-					}
-					if (event.key.keysym.sym == SDLK_F2) {
-						load_state();
-					}
-					if(event.key.keysym.sym == SDLK_ESCAPE) {
-						quit();
-						exit(0);
-					}
-					if (event.key.keysym.sym == SDLK_LCTRL) {
-						is_turbo = 1;
-						is_delayed = 0;
-						break;
-					}
-				case SDL_KEYUP:
-					if (event.key.keysym.sym == SDLK_LCTRL) {
-						is_turbo = 0;
-					}
-					key_event(&event.key);
-					break;
-				default:
-					break;
-			}
+		/* a backend without a clock just runs as fast as it can. Otherwise
+		 * keep to the lcd's frame rate, but don't try to catch up on time
+		 * spent paused, in turbo or running slow */
+		if (backend->ticks != NULL) {
+			if (is_paused)
+				backend->delay(10);
+			now = backend->ticks() * 1000ULL;
+			due += FRAME_US;
+			if (is_paused || is_turbo || now > due + 100000)
+				due = now;
+			else if (due > now + 1000)
+				backend->delay((due - now) / 1000);
 		}
 	}
+	quit();
 	return 0;
-}
 
-// reset the emulator. must be called before ROM execution.
-void reset(void) {
-	// the order in which these are called is important
-	memory_reset();
-	cart_reset();
-	core_reset();
-	display_reset();
-	timer_reset();
-	sound_reset();
+	/* nothing has run, so there is nothing for quit() to save */
+failed:
+	gbem_free(game);
+	backend->fini();
+	return 1;
 }
 
 void quit(void) {
-	sound_fini();
-	unload_rom();
-	display_fini();
-	memory_fini();
-	SDL_Quit();
+	if (record_fn != NULL)
+		gbem_movie_save(game, record_fn);
+	if (hash_fn != NULL)
+		gbem_hash_save(game, hash_fn);
+	if (is_hashing)
+		gbem_hash_report(game, stderr);
+	if (profile_fn != NULL) {
+		char *fn = malloc(strlen(profile_fn) + 8);
+		sprintf(fn, "%s.txt", profile_fn);
+		profile_report(fn);
+		sprintf(fn, "%s.folded", profile_fn);
+		profile_folded(fn);
+		free(fn);
+	}
+	gbem_free(game);
+	backend->fini();
 }
 
 void new_frame(void) {
@@ -24,6 +24,7 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -34,31 +35,88 @@
 #include "joypad.h"
 #include "sound.h"
 #include "save.h"
+#include "timer.h"
+#include "idle.h"
 
 #include "serial2sock.h"
 
-#define ADDRESS_SPACE		0x10000
-#define VT_ENTRIES 			(ADDRESS_SPACE / VT_GRANULARITY)
 #define VT_SIZE 			(VT_ENTRIES * sizeof(Byte*))
-#define SIZE_HIMEM 			(SIZE_IO + SIZE_INTERNAL_1)
 
-Byte *internal0 = NULL;
-Byte** vector_table = NULL;
-Byte* himem = NULL;
+/* writes to 0xFF00-0xFF7F, one handler per register. The same for every
+ * instance, so built once, see memory_init() */
+static WriteHandler io_handler_table[SIZE_IO];
 
-unsigned int iram_bank = 1;
-
-extern int console;
-extern int console_mode;
+static void map_internal(void);
+static void write_video(Word address, Byte value);
+static void write_cart(Word address, Byte value);
+static void write_oam_page(Word address, Byte value);
+static void write_high(Word address, Byte value);
+static void write_io_plain(Word address, Byte value);
+static void write_stat(Word address, Byte value);
+static void write_lcdc(Word address, Byte value);
+static void write_key1(Word address, Byte value);
+static void write_scroll(Word address, Byte value);
+static void write_palette(Word address, Byte value);
+static void write_dma(Word address, Byte value);
+static void write_p1(Word address, Byte value);
+static void write_ly(Word address, Byte value);
+static void write_sc(Word address, Byte value);
+static void write_svbk(Word address, Byte value);
+static void write_vbk(Word address, Byte value);
+static void write_hdma5(Word address, Byte value);
+static void write_bgpd(Word address, Byte value);
+static void write_obpd(Word address, Byte value);
+static void write_if(Word address, Byte value);
 
 unsigned mem_map[256];
 
+static void io_handler_build(void) {
+	int i;
+
+	for (i = 0; i < SIZE_IO; i++)
+		io_handler_table[i] = write_io_plain;
+	/* sound registers and wave data are dealt with in the sound code */
+	for (i = 0xff10; i < 0xff30; i++)
+		io_handler_table[i - MEM_IO] = write_sound;
+	for (i = 0xff30; i <= 0xff3f; i++)
+		io_handler_table[i - MEM_IO] = write_wave;
+	io_handler_table[HWREG_STAT - MEM_IO] = write_stat;
+	io_handler_table[HWREG_LCDC - MEM_IO] = write_lcdc;
+	io_handler_table[HWREG_KEY1 - MEM_IO] = write_key1;
+	io_handler_table[HWREG_DIV - MEM_IO] = timer_write;
+	io_handler_table[HWREG_TIMA - MEM_IO] = timer_write;
+	io_handler_table[HWREG_TMA - MEM_IO] = timer_write;
+	io_handler_table[HWREG_TAC - MEM_IO] = timer_write;
+	io_handler_table[HWREG_SCY - MEM_IO] = write_scroll;
+	io_handler_table[HWREG_SCX - MEM_IO] = write_scroll;
+	io_handler_table[HWREG_WY - MEM_IO] = write_scroll;
+	io_handler_table[HWREG_WX - MEM_IO] = write_scroll;
+	io_handler_table[HWREG_BGP - MEM_IO] = write_palette;
+	io_handler_table[HWREG_OBP0 - MEM_IO] = write_palette;
+	io_handler_table[HWREG_OBP1 - MEM_IO] = write_palette;
+	io_handler_table[HWREG_DMA - MEM_IO] = write_dma;
+	io_handler_table[HWREG_P1 - MEM_IO] = write_p1;
+	io_handler_table[HWREG_LY - MEM_IO] = write_ly;
+	io_handler_table[HWREG_LYC - MEM_IO] = write_ly;
+	io_handler_table[HWREG_SC - MEM_IO] = write_sc;
+	io_handler_table[HWREG_SVBK - MEM_IO] = write_svbk;
+	io_handler_table[HWREG_VBK - MEM_IO] = write_vbk;
+	io_handler_table[HWREG_HDMA5 - MEM_IO] = write_hdma5;
+	io_handler_table[HWREG_BGPD - MEM_IO] = write_bgpd;
+	io_handler_table[HWREG_OBPD - MEM_IO] = write_obpd;
+	io_handler_table[HWREG_IF - MEM_IO] = write_if;
+}
+
+/* fill in io_handler_table. Only the first call does anything, whichever
+ * thread (and instance) it comes from */
 void memory_init(void) {
-	himem = malloc (sizeof(Byte) * SIZE_HIMEM);
-	vector_table = malloc(sizeof(Byte*) * VT_ENTRIES);
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+	pthread_once(&once, io_handler_build);
 }
 
 void memory_reset(void) {
+	memory_init();
 	if (internal0 != NULL)
 		free(internal0);
 
@@ -70,171 +128,174 @@ void memory_reset(void) {
 
 	iram_bank = 1;
 
-	set_vector_block(MEM_INTERNAL_0, internal0, SIZE_INTERNAL_0);
-	set_vector_block(MEM_INTERNAL_SW, internal0 + (iram_bank * 0x1000), SIZE_INTERNAL_SW);
-	set_vector_block(MEM_INTERNAL_ECHO, internal0, SIZE_INTERNAL_0);
-	set_vector_block(MEM_INTERNAL_ECHO + SIZE_INTERNAL_0, internal0 + (iram_bank * 0x1000), SIZE_INTERNAL_ECHO - SIZE_INTERNAL_0);
-	set_vector_block(MEM_IO, himem, SIZE_HIMEM);
+	/* the io page is left unmapped for reads, see read_high() */
+	map_internal();
+
+	/* everything but internal ram has side effects on write */
+	set_write_handler_block(MEM_ROM_BANK_0, write_rom, SIZE_ROM_BANK_0 + SIZE_ROM_BANK_SW);
+	set_write_handler_block(MEM_VIDEO, write_video, SIZE_VIDEO);
+	set_write_handler_block(MEM_RAM_BANK_SW, write_cart, SIZE_RAM_BANK_SW);
+	set_write_handler_block(MEM_OAM, write_oam_page, VT_GRANULARITY);
+	set_write_handler_block(MEM_IO, write_high, VT_GRANULARITY);
 }
 
 void memory_fini(void) {
 	free(internal0);
-	free(himem);
-	free(vector_table);
+	internal0 = NULL;
 }
 
-void writeb(Word address, Byte value) {
-	// cartridge rom area
-	if (address < MEM_VIDEO) {
-		write_rom(address, value);
-	}
-	// video ram area
-	else if (address < MEM_VIDEO + SIZE_VIDEO) {
-		write_vram(address, value);
-		return;
-	}
-	// cartridge ram area
-	else if (address < MEM_RAM_BANK_SW + SIZE_RAM_BANK_SW) {
-		write_cart_ram(address - MEM_RAM_BANK_SW, value);
-		return;
-	}
-	// internal ram area 0
-	else if (address < MEM_INTERNAL_0 + SIZE_INTERNAL_0) {
-		internal0[address - MEM_INTERNAL_0] = value;
-		return;
-	}
-	// internal ram area switchable
-	else if (address < MEM_INTERNAL_SW + SIZE_INTERNAL_SW) {
-		internal0[(iram_bank * 0x1000) + address - MEM_INTERNAL_SW] = value;
-		return;
-	}	
-	// echo of internal ram area 0
-	else if (address < MEM_INTERNAL_ECHO + SIZE_INTERNAL_ECHO) {
-		fprintf(stderr, "ECHO %hx\n", address);
-		if (address < MEM_INTERNAL_ECHO + SIZE_INTERNAL_0)
-			internal0[address - MEM_INTERNAL_ECHO] = value;
-		else
-			internal0[(iram_bank * 0x1000) + address - MEM_INTERNAL_ECHO - SIZE_INTERNAL_0] = value;
-		return;
-	}
-	// sprite attrib (oam) ram
-	else if (address < MEM_OAM + SIZE_OAM) {
+/* point internal ram and its echo at the current bank, for both reads
+ * and writes */
+static void map_internal(void) {
+	Byte *bank = internal0 + (iram_bank * 0x1000);
+
+	set_vector_block(MEM_INTERNAL_0, internal0, SIZE_INTERNAL_0);
+	set_vector_block(MEM_INTERNAL_SW, bank, SIZE_INTERNAL_SW);
+	set_vector_block(MEM_INTERNAL_ECHO, internal0, SIZE_INTERNAL_0);
+	set_vector_block(MEM_INTERNAL_ECHO + SIZE_INTERNAL_0, bank, SIZE_INTERNAL_ECHO - SIZE_INTERNAL_0);
+
+	set_write_vector_block(MEM_INTERNAL_0, internal0, SIZE_INTERNAL_0);
+	set_write_vector_block(MEM_INTERNAL_SW, bank, SIZE_INTERNAL_SW);
+	set_write_vector_block(MEM_INTERNAL_ECHO, internal0, SIZE_INTERNAL_0);
+	set_write_vector_block(MEM_INTERNAL_ECHO + SIZE_INTERNAL_0, bank, SIZE_INTERNAL_ECHO - SIZE_INTERNAL_0);
+}
+
+/* write handlers for the pages that aren't plain ram */
+static void write_video(Word address, Byte value) {
+	write_vram(address, value);
+}
+
+static void write_cart(Word address, Byte value) {
+	write_cart_ram(address - MEM_RAM_BANK_SW, value);
+}
+
+static void write_oam_page(Word address, Byte value) {
+	// sprite attrib (oam) ram; the rest of the page is unusable
+	if (address < MEM_OAM + SIZE_OAM)
 		write_oam(address, value);
-		return;
-	}
-	// unusable memory
-	else if (address < MEM_IO) {
-		//printf("Bad memory write to unusable location (%hx)!\n", address);
-		return;
+}
+
+/* reads from 0xFF00-0xFFFF. DIV and TIMA only count up when the timer is
+ * synced, so bring them up to date first. A loop that polls them sees a
+ * different value each pass, so it mustn't be skipped */
+Byte read_high(Word address) {
+	if (address == HWREG_DIV || address == HWREG_TIMA) {
+		timer_sync();
+		idle_break();
 	}
+	return himem[address - MEM_IO];
+}
+
+static void write_high(Word address, Byte value) {
 	// i/o memory
-	else if (address < MEM_IO + SIZE_IO) {
-	//if (address == HWREG_KEY1)
-	//	fprintf(stderr, "KEY1: VALUE: %hhx\n", value);
-
-		/* sound registers are dealt with in the sound code */
-		if ((address >= 0xff10) && (address < 0xff30)) {
-			write_sound(address, value);
-			return;
-		}
-		/* sound wave data is dealt with in the sound code */
-		if ((address >= 0xff30) && (address  <= 0xff3f)) {
-			write_wave(address, value);
-			return;
-		}
-
-		/* special writes here */
-		switch (address) {
-			case HWREG_STAT:
-			/* the bottom 3 bits of STAT are read only.	*/
-				himem[address - MEM_IO] = (himem[address - MEM_IO] & 0x07) 
-                	| (value & 0xF8);
-				return;
-				break;
-			case HWREG_LCDC:
-				set_lcdc(value);
-				break;
-			case HWREG_KEY1:
-				/* the top bit of KEY1 is read only */
-				himem[address - MEM_IO] = (himem[address - MEM_IO] & 0x80) | (value & 0x7f);
-				return;
-                break;
-			case HWREG_NR52:
-				himem[address - MEM_IO] = (himem[address - MEM_IO] & 0x0f) | (value & 0x80);
-				break;
-			case HWREG_DIV:
-				// If DIV is written to, it is set to 0.
-				himem[address - MEM_IO] = 0;
-				break;
-			default:
-				himem[address - MEM_IO] = value;
-				//printf("%hx: %hhx\n", address, value);
-				break;
-		}
-
-		switch(address) {
-			case HWREG_BGP:
-				if (console_mode != MODE_GBC_ENABLED) 
-					update_bg_palette(0, value);
-				break;
-			case HWREG_OBP0:
-				if (console_mode != MODE_GBC_ENABLED)
-					update_sprite_palette(0, value);
-				break;
-			case HWREG_OBP1:
-				if (console_mode != MODE_GBC_ENABLED)
-					update_sprite_palette(1, value);
-				break;
-			case HWREG_DMA:
-				launch_dma(value);
-				break;
-			case HWREG_P1:
-				update_p1();
-				break;
-			case HWREG_LY:
-			case HWREG_LYC:
-				write_io(HWREG_STAT, check_coincidence(read_io(HWREG_LY), read_io(HWREG_STAT)));
-				break;
-			case HWREG_SC:
-				serial_tx(readb(HWREG_SB), value);
-				break;
-			case HWREG_SVBK:
-				/* adjust internal ram bank in gameboy color mode */
-				if (console_mode == MODE_GBC_ENABLED) {
-					iram_bank = value & 0x07;
-					if (iram_bank == 0)
-						iram_bank = 1;
-					set_vector_block(MEM_INTERNAL_SW, internal0 + (iram_bank * 0x1000), SIZE_INTERNAL_SW);
-					set_vector_block(MEM_INTERNAL_ECHO + SIZE_INTERNAL_0, internal0 + (iram_bank * 0x1000), SIZE_INTERNAL_ECHO - SIZE_INTERNAL_0);
-				}
-				break;
-			case HWREG_VBK:
-				/* adjust vram bank */
-				if (console_mode == MODE_GBC_ENABLED)
-					set_vram_bank(value & 0x01);
-				break;
-			case HWREG_HDMA5:
-				/* initiate gbc hdma */
-				if (console_mode == MODE_GBC_ENABLED)
-					start_hdma(value);
-				break;
-			case HWREG_BGPD:
-				update_gbc_bg_palette(value);
-				break;
-			case HWREG_OBPD:
-				update_gbc_spr_palette(value);
-				break;
-
-		}
+	if (address < MEM_IO + SIZE_IO) {
+		io_handler_table[address - MEM_IO](address, value);
 		return;
 	}
 	// internal ram area 1
-	else {
-		himem[address - MEM_IO] = value;
+	himem[address - MEM_IO] = value;
+	if (address == HWREG_IE)
+		update_ints();
+}
+
+/* i/o register write handlers, see io_handler_table */
+static void write_io_plain(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+}
+
+static void write_stat(Word address, Byte value) {
+	/* the bottom 3 bits of STAT are read only.	*/
+	himem[address - MEM_IO] = (himem[address - MEM_IO] & 0x07) 
+		| (value & 0xF8);
+}
+
+static void write_lcdc(Word address, Byte value) {
+	set_lcdc(value);
+}
+
+static void write_key1(Word address, Byte value) {
+	/* the top bit of KEY1 is read only */
+	himem[address - MEM_IO] = (himem[address - MEM_IO] & 0x80) | (value & 0x7f);
+}
+
+static void write_scroll(Word address, Byte value) {
+	if (himem[address - MEM_IO] != value)
+		display_changing();
+	himem[address - MEM_IO] = value;
+}
+
+static void write_palette(Word address, Byte value) {
+	if (himem[address - MEM_IO] != value)
+		display_changing();
+	himem[address - MEM_IO] = value;
+	if (console_mode == MODE_GBC_ENABLED)
 		return;
+	if (address == HWREG_BGP)
+		update_bg_palette(0, value);
+	else
+		update_sprite_palette(address == HWREG_OBP1, value);
+}
+
+static void write_dma(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	launch_dma(value);
+}
+
+static void write_p1(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	update_p1();
+}
+
+static void write_ly(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	write_io(HWREG_STAT, check_coincidence(read_io(HWREG_LY), read_io(HWREG_STAT)));
+}
+
+static void write_sc(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	serial_tx(readb(HWREG_SB), value);
+}
+
+static void write_svbk(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	/* adjust internal ram bank in gameboy color mode */
+	if (console_mode == MODE_GBC_ENABLED) {
+		iram_bank = value & 0x07;
+		if (iram_bank == 0)
+			iram_bank = 1;
+		map_internal();
 	}
 }
 
+static void write_vbk(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	/* adjust vram bank */
+	if (console_mode == MODE_GBC_ENABLED)
+		set_vram_bank(value & 0x01);
+}
+
+static void write_hdma5(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	/* initiate gbc hdma */
+	if (console_mode == MODE_GBC_ENABLED)
+		start_hdma(value);
+}
+
+static void write_bgpd(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	update_gbc_bg_palette(value);
+}
+
+static void write_obpd(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	update_gbc_spr_palette(value);
+}
+
+static void write_if(Word address, Byte value) {
+	himem[address - MEM_IO] = value;
+	update_ints();
+}
+
 void memory_save(void) {
 	if ((console = CONSOLE_GBC) || (console = CONSOLE_GBA))
 		save_memory("iram", internal0, IMEM_SIZE_GBC);
@@ -256,14 +317,9 @@ void memory_load(void) {
 	load_memory("himem", himem, SIZE_HIMEM);
 	iram_bank = load_uint("iram_bank");
 
+	map_internal();
 
-	set_vector_block(MEM_INTERNAL_0, internal0, SIZE_INTERNAL_0);
-	set_vector_block(MEM_INTERNAL_SW, internal0 + (iram_bank * 0x1000), SIZE_INTERNAL_SW);
-	set_vector_block(MEM_INTERNAL_ECHO, internal0, SIZE_INTERNAL_0);
-	set_vector_block(MEM_INTERNAL_ECHO + SIZE_INTERNAL_0, internal0 + (iram_bank * 0x1000), SIZE_INTERNAL_ECHO - SIZE_INTERNAL_0);
-	set_vector_block(MEM_IO, himem, SIZE_HIMEM);
-
-
+	update_ints();
 }
 
 
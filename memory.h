@@ -30,16 +30,43 @@
 #include <stdio.h>
 #include "gbem.h"
 
-#define VT_GRANULARITY 0x100
+#define VT_GRANULARITY		0x100
+#define ADDRESS_SPACE		0x10000
+#define VT_ENTRIES 			(ADDRESS_SPACE / VT_GRANULARITY)
+#define SIZE_HIMEM 			(SIZE_IO + SIZE_INTERNAL_1)
+
+/* handles writes to a page that isn't plain ram */
+typedef void (*WriteHandler)(Word address, Byte value);
+
+typedef struct {
+	Byte *internal0;							/* work ram, all eight banks */
+	Byte *vector_table[VT_ENTRIES];				/* host memory of each page, for reads, NULL for 0xFF00 */
+	Byte *write_vector_table[VT_ENTRIES];		/* and for writes, NULL if it has a handler */
+	WriteHandler write_handler_table[VT_ENTRIES];
+	Byte himem[SIZE_HIMEM];						/* io registers and high ram */
+	unsigned int iram_bank;
+} MemoryState;
+
+/* the address space of the selected instance, see instance.h. The page
+ * tables are kept in the struct rather than allocated so reaching them
+ * costs no more than it did when they were globals */
+extern __thread MemoryState *gb_memory;
+#define internal0				(gb_memory->internal0)
+#define vector_table			(gb_memory->vector_table)
+#define write_vector_table		(gb_memory->write_vector_table)
+#define write_handler_table		(gb_memory->write_handler_table)
+#define himem					(gb_memory->himem)
+#define iram_bank				(gb_memory->iram_bank)
 
 void memory_reset(void);
 void memory_init(void);
 void memory_fini(void);
 void memory_save(void);
 void memory_load(void);
+Byte read_high(Word address);
 
 static inline Byte readb(Word address);
-void writeb(Word address, Byte value);
+static inline void writeb(Word address, Byte value);
 static inline Word readw(Word address);
 static inline void writew(Word address, Word w);
 
@@ -49,6 +76,8 @@ static inline Byte read_io(Word address);
 static inline void set_vector(Word address, Byte* real_address);
 static inline Byte* get_vector(Word address);
 static inline void set_vector_block(Word address, Byte* real_address, unsigned c);
+static inline void set_write_vector_block(Word address, Byte* real_address, unsigned c);
+static inline void set_write_handler_block(Word address, WriteHandler handler, unsigned c);
 
 
 static inline Word readw(Word address) {
@@ -74,28 +103,28 @@ static inline void writew(Word address, Word w) {
 }
 
 static inline void write_io(Word address, Byte value) {
-	extern Byte* himem;
 	himem[address - MEM_IO] = value;
 }
 
 static inline Byte read_io(Word address) {
-	extern Byte* himem;
 	return himem[address - MEM_IO];
 }
 
 static inline void set_vector(Word address, Byte* real_address) {
-	extern Byte** vector_table;
 	vector_table[address] = real_address;
 }
 
 static inline Byte* get_vector(Word address) {
-	extern Byte** vector_table;
 	return vector_table[address];
 }
 
+/* reads from pages with a vector are plain loads, the rest are io */
 static inline Byte readb(Word address) {
-	extern Byte** vector_table;
-	return *(vector_table[address >> 8] + (address & 0xFF));
+	Byte *page = vector_table[address >> 8];
+
+	if (page != NULL)
+		return page[address & 0xFF];
+	return read_high(address);
 }
 
 static inline void set_vector_block(Word address, Byte* real_address, unsigned c) {
@@ -105,4 +134,30 @@ static inline void set_vector_block(Word address, Byte* real_address, unsigned c
 	}
 }
 
+/* writes to pages with a write vector are plain stores, the rest go to
+ * the page's handler */
+static inline void writeb(Word address, Byte value) {
+	Byte *page = write_vector_table[address >> 8];
+
+	if (page != NULL)
+		page[address & 0xFF] = value;
+	else
+		write_handler_table[address >> 8](address, value);
+}
+
+static inline void set_write_vector_block(Word address, Byte* real_address, unsigned c) {
+	unsigned int i;
+	for (i = 0; i < (c / VT_GRANULARITY); i++) {
+		write_vector_table[(address >> 8) + i] = real_address + (i * VT_GRANULARITY);
+	}
+}
+
+static inline void set_write_handler_block(Word address, WriteHandler handler, unsigned c) {
+	unsigned int i;
+	for (i = 0; i < (c / VT_GRANULARITY); i++) {
+		write_vector_table[(address >> 8) + i] = NULL;
+		write_handler_table[(address >> 8) + i] = handler;
+	}
+}
+
 #endif /* _MEMORY_H */
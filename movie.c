@@ -0,0 +1,234 @@
+/*
+ * movie.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "movie.h"
+#include "cart.h"
+
+#define MOVIE_MAGIC_SIZE	4
+#define MOVIE_HEADER		(MOVIE_MAGIC_SIZE + 3)
+#define MOVIE_RECORD_MAX	6		/* a 32 bit varint and the buttons */
+
+static Word rom_checksum(void) {
+	if (!cart.is_loaded)
+		return 0;
+	return (cart.rom[CART_CHECKSUM] << 8) | cart.rom[CART_CHECKSUM + 1];
+}
+
+static void put_byte(Movie *m, Byte b) {
+	if (m->size == m->capacity) {
+		m->capacity = m->capacity ? m->capacity * 2 : 256;
+		m->data = realloc(m->data, m->capacity);
+	}
+	m->data[m->size++] = b;
+}
+
+/* the record for the current run, returns its length */
+static unsigned int encode_run(const Movie *m, Byte *record) {
+	unsigned int n = m->left, len = 0;
+
+	while (n >= 0x80) {
+		record[len++] = (n & 0x7F) | 0x80;
+		n >>= 7;
+	}
+	record[len++] = n;
+	record[len++] = m->buttons;
+	return len;
+}
+
+/* end the current run, if there is one */
+static void put_run(Movie *m) {
+	Byte record[MOVIE_RECORD_MAX];
+	unsigned int len, i;
+
+	if (m->left == 0)
+		return;
+	len = encode_run(m, record);
+	for (i = 0; i < len; i++)
+		put_byte(m, record[i]);
+	m->left = 0;
+}
+
+/* start the next run, or finish if there isn't one */
+static void get_run(Movie *m) {
+	unsigned int n = 0, shift = 0;
+	Byte b;
+
+	m->left = 0;
+	while (m->left == 0) {
+		if (m->pos >= m->size) {
+			m->is_done = 1;
+			return;
+		}
+		do {
+			b = m->data[m->pos++];
+			n |= (unsigned int)(b & 0x7F) << shift;
+			shift += 7;
+		} while ((b & 0x80) && m->pos < m->size && shift < 32);
+		if (m->pos >= m->size) {
+			m->is_done = 1;
+			return;
+		}
+		m->buttons = m->data[m->pos++];
+		m->left = n;
+		n = 0;
+		shift = 0;
+	}
+}
+
+/* a new recording, for the rom loaded in the selected instance */
+Movie *movie_record(void) {
+	Movie *m = calloc(1, sizeof(Movie));
+
+	m->mode = MOVIE_RECORD;
+	m->checksum = rom_checksum();
+	return m;
+}
+
+/* a movie to play back, from a file's contents. NULL if it isn't one */
+Movie *movie_from_buffer(const void *data, unsigned int size) {
+	const Byte *p = data;
+	Movie *m;
+
+	if (size < MOVIE_HEADER || memcmp(p, MOVIE_MAGIC, MOVIE_MAGIC_SIZE) != 0) {
+		fprintf(stderr, "not a movie\n");
+		return NULL;
+	}
+	if (p[4] != MOVIE_VERSION) {
+		fprintf(stderr, "movie version %u not supported\n", p[4]);
+		return NULL;
+	}
+	m = calloc(1, sizeof(Movie));
+	m->mode = MOVIE_PLAY;
+	m->checksum = (p[5] << 8) | p[6];
+	m->size = m->capacity = size - MOVIE_HEADER;
+	m->data = malloc(m->size > 0 ? m->size : 1);
+	memcpy(m->data, p + MOVIE_HEADER, m->size);
+	if (cart.is_loaded && m->checksum != rom_checksum())
+		fprintf(stderr, "movie was recorded on another rom, "
+		        "checksum %04x\n", m->checksum);
+	movie_rewind(m);
+	return m;
+}
+
+Movie *movie_load(const char *fn) {
+	FILE *fp;
+	Byte *data;
+	long len;
+	Movie *m;
+
+	fp = fopen(fn, "rb");
+	if (fp == NULL) {
+		fprintf(stderr, "could not open movie: %s\n", fn);
+		perror("fopen");
+		return NULL;
+	}
+	fseek(fp, 0, SEEK_END);
+	len = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	data = malloc(len > 0 ? len : 1);
+	if (len < 0 || fread(data, 1, len, fp) != (size_t)len) {
+		fprintf(stderr, "could not read movie: %s\n", fn);
+		free(data);
+		fclose(fp);
+		return NULL;
+	}
+	fclose(fp);
+	m = movie_from_buffer(data, len);
+	free(data);
+	return m;
+}
+
+/* write a recording out. It can carry on recording afterwards */
+int movie_save(const Movie *m, const char *fn) {
+	FILE *fp;
+	Byte header[MOVIE_HEADER];
+	Byte record[MOVIE_RECORD_MAX];
+
+	fp = fopen(fn, "wb");
+	if (fp == NULL) {
+		fprintf(stderr, "could not open movie for writing: %s\n", fn);
+		perror("fopen");
+		return -1;
+	}
+	memcpy(header, MOVIE_MAGIC, MOVIE_MAGIC_SIZE);
+	header[4] = MOVIE_VERSION;
+	header[5] = m->checksum >> 8;
+	header[6] = m->checksum & 0xFF;
+	fwrite(header, 1, sizeof(header), fp);
+	fwrite(m->data, 1, m->size, fp);
+	/* the run in progress is written but stays open */
+	if (m->left != 0)
+		fwrite(record, 1, encode_run(m, record), fp);
+	fclose(fp);
+	return 0;
+}
+
+void movie_free(Movie *m) {
+	if (m == NULL)
+		return;
+	free(m->data);
+	free(m);
+}
+
+/* back to the start, for a reset: a recording starts again, empty, and a
+ * movie being played plays from the beginning */
+void movie_rewind(Movie *m) {
+	if (m->mode == MOVIE_RECORD) {
+		m->size = 0;
+		m->left = 0;
+		m->buttons = 0;
+		return;
+	}
+	m->pos = 0;
+	m->is_done = 0;
+	get_run(m);
+}
+
+unsigned int movie_poll(Movie *m, unsigned int buttons) {
+	if (m->mode == MOVIE_RECORD) {
+		if (buttons != m->buttons) {
+			put_run(m);
+			m->buttons = buttons;
+		}
+		++m->left;
+		return buttons;
+	}
+	if (m->is_done)
+		return buttons;
+	buttons = m->buttons;
+	if (--m->left == 0)
+		get_run(m);
+	return buttons;
+}
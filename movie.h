@@ -0,0 +1,77 @@
+/*
+ * movie.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _MOVIE_H
+#define _MOVIE_H
+
+#include "gbem.h"
+
+/* input movies: the buttons the game saw each time it wrote P1 to poll
+ * the joypad, from reset on. A movie played back into the same rom gives
+ * the same run, frame for frame, whatever the host, the timing or the
+ * front end.
+ *
+ * A movie file is "GBMV", a version byte, the rom's header checksum (two
+ * bytes, as in the rom), then records of a run length, as a little endian
+ * base 128 varint, and the buttons held for that many polls, as a byte
+ * with bit n for button n of joypad.h. */
+
+#define MOVIE_MAGIC			"GBMV"
+#define MOVIE_VERSION		1
+
+typedef enum {
+	MOVIE_RECORD,
+	MOVIE_PLAY
+} MovieMode;
+
+typedef struct {
+	MovieMode mode;
+	Byte *data;				/* records */
+	unsigned int size, capacity;
+	unsigned int pos;		/* next record, when playing */
+	unsigned int buttons;	/* those of the current run */
+	unsigned int left;		/* polls left in the current run when
+							 * playing, or in it so far when recording */
+	Word checksum;			/* of the rom it was recorded on */
+	int is_done;			/* played to the end */
+} Movie;
+
+Movie *movie_record(void);
+Movie *movie_load(const char *fn);
+Movie *movie_from_buffer(const void *data, unsigned int size);
+int movie_save(const Movie *m, const char *fn);
+void movie_free(Movie *m);
+void movie_rewind(Movie *m);
+/* called from update_p1() with the buttons held now. Returns the buttons
+ * the game sees */
+unsigned int movie_poll(Movie *m, unsigned int buttons);
+
+#endif /* _MOVIE_H */
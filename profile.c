@@ -0,0 +1,349 @@
+/*
+ * profile.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "core.h"
+#include "memory.h"
+#include "cart.h"
+#include "debug.h"
+
+typedef struct {
+	uint64_t count;
+	uint64_t cycles;
+} ProfileCount;
+
+/* an instruction, by bank and pc */
+typedef struct {
+	uint32_t key;			/* bank << 16 | pc */
+	ProfileCount n;			/* empty while count is 0 */
+} ProfileSpot;
+
+/* a call stack, as a node in the tree of them all */
+typedef struct {
+	uint32_t key;			/* where the function starts, as a spot's key */
+	int is_irq;
+	int child, sibling;		/* -1 for none */
+	uint64_t cycles;		/* run in the function itself, not its callees */
+} ProfileNode;
+
+static ProfileSpot *spots;
+static unsigned int spot_count, spot_capacity;	/* a power of two */
+static ProfileCount ops[256], cb_ops[256];
+static ProfileNode *nodes;						/* the root first */
+static unsigned int node_count, node_capacity;
+
+/* the call stack, the root first: the node of each frame and sp after
+ * the call into it */
+static int stack_node[PROFILE_DEPTH];
+static Word stack_sp[PROFILE_DEPTH];
+static unsigned int depth;
+
+/* the instruction under way */
+static unsigned int spot;
+static ProfileCount *op;
+static Byte opcode;
+static Word op_sp;
+/* where the last one left pc and sp, to spot interrupts being taken */
+static Word last_pc, last_sp;
+static int is_running;
+
+static uint32_t spot_key(Word pc) {
+	unsigned int bank;
+
+	if (pc < 0x4000)
+		bank = 0;
+	else if (pc < 0x8000)
+		bank = cart.rom_bank + (cart.rom_block * 0x20);
+	else
+		bank = PROFILE_RAM;
+	return (bank << 16) | pc;
+}
+
+static inline unsigned int spot_hash(uint32_t key) {
+	return (key * 2654435761u) & (spot_capacity - 1);
+}
+
+static void grow_spots(void) {
+	ProfileSpot *old = spots;
+	unsigned int old_capacity = spot_capacity, i, h;
+
+	spot_capacity = spot_capacity ? spot_capacity * 2 : 4096;
+	spots = calloc(spot_capacity, sizeof(ProfileSpot));
+	for (i = 0; i < old_capacity; i++) {
+		if (old[i].n.count == 0)
+			continue;
+		for (h = spot_hash(old[i].key); spots[h].n.count != 0;
+		     h = (h + 1) & (spot_capacity - 1))
+			;
+		spots[h] = old[i];
+	}
+	free(old);
+}
+
+/* the slot of the spot, which is added if it is new */
+static unsigned int find_spot(uint32_t key) {
+	unsigned int h;
+
+	if ((spot_count + 1) * 2 > spot_capacity)
+		grow_spots();
+	for (h = spot_hash(key); spots[h].n.count != 0;
+	     h = (h + 1) & (spot_capacity - 1)) {
+		if (spots[h].key == key)
+			return h;
+	}
+	spots[h].key = key;
+	++spot_count;
+	return h;
+}
+
+static int add_node(uint32_t key, int is_irq) {
+	if (node_count == node_capacity) {
+		node_capacity = node_capacity ? node_capacity * 2 : 1024;
+		nodes = realloc(nodes, node_capacity * sizeof(ProfileNode));
+	}
+	nodes[node_count].key = key;
+	nodes[node_count].is_irq = is_irq;
+	nodes[node_count].child = -1;
+	nodes[node_count].sibling = -1;
+	nodes[node_count].cycles = 0;
+	return node_count++;
+}
+
+/* into a function, from a call or an interrupt. Deeper than PROFILE_DEPTH
+ * the cycles go to the deepest frame followed, and the sp of each frame
+ * makes sure the returns from those it missed don't unwind it */
+static void push(uint32_t key, int is_irq) {
+	int parent = stack_node[depth - 1], n;
+
+	if (depth == PROFILE_DEPTH)
+		return;
+	for (n = nodes[parent].child; n >= 0; n = nodes[n].sibling) {
+		if (nodes[n].key == key && nodes[n].is_irq == is_irq)
+			break;
+	}
+	if (n < 0) {
+		n = add_node(key, is_irq);
+		nodes[n].sibling = nodes[parent].child;
+		nodes[parent].child = n;
+	}
+	stack_node[depth] = n;
+	stack_sp[depth] = core.reg_sp;
+	++depth;
+}
+
+/* out of every frame the return has taken sp past. Games that drop a
+ * return address and jump back do not confuse it for long */
+static void pop(void) {
+	while (depth > 1 && stack_sp[depth - 1] < core.reg_sp)
+		--depth;
+}
+
+void profile_reset(void) {
+	free(spots);
+	spots = NULL;
+	spot_count = spot_capacity = 0;
+	memset(ops, 0, sizeof(ops));
+	memset(cb_ops, 0, sizeof(cb_ops));
+	node_count = 0;
+	stack_node[0] = add_node(0, 0);
+	depth = 1;
+	is_running = 0;
+}
+
+void profile_op(Word pc) {
+	if (nodes == NULL)
+		profile_reset();
+	/* taking an interrupt pushes pc and jumps to the handler */
+	if (is_running && pc != last_pc && core.reg_sp == (Word)(last_sp - 2))
+		push(spot_key(pc), 1);
+	spot = find_spot(spot_key(pc));
+	opcode = readb(pc);
+	op = opcode == 0xCB ? &cb_ops[readb(pc + 1)] : &ops[opcode];
+	op_sp = core.reg_sp;
+}
+
+void profile_done(unsigned int cycles) {
+	++spots[spot].n.count;
+	spots[spot].n.cycles += cycles;
+	++op->count;
+	op->cycles += cycles;
+	nodes[stack_node[depth - 1]].cycles += cycles;
+
+	switch (opcode) {
+	case 0xCD: case 0xC4: case 0xCC: case 0xD4: case 0xDC:	/* CALL */
+	case 0xC7: case 0xCF: case 0xD7: case 0xDF:				/* RST */
+	case 0xE7: case 0xEF: case 0xF7: case 0xFF:
+		/* unless the condition failed */
+		if (core.reg_sp == (Word)(op_sp - 2))
+			push(spot_key(core.reg_pc), 0);
+		break;
+	case 0xC9: case 0xC0: case 0xC8: case 0xD0: case 0xD8:	/* RET */
+	case 0xD9:												/* RETI */
+		if (core.reg_sp == (Word)(op_sp + 2))
+			pop();
+		break;
+	}
+	last_pc = core.reg_pc;
+	last_sp = core.reg_sp;
+	is_running = 1;
+}
+
+/* the bytes of the instruction at the spot, from the rom if it's in it */
+static void spot_code(uint32_t key, Byte *code) {
+	unsigned int bank = key >> 16, pc = key & 0xFFFF, i, address;
+
+	for (i = 0; i < 3; i++) {
+		if (bank == PROFILE_RAM) {
+			code[i] = readb(pc + i);
+			continue;
+		}
+		address = (pc + i) < 0x4000 ? pc + i : bank * 0x4000 + ((pc + i) & 0x3FFF);
+		code[i] = address < cart.rom_size ? cart.rom[address] : 0;
+	}
+}
+
+static void spot_name(uint32_t key, char *buf, int size) {
+	if ((key >> 16) == PROFILE_RAM)
+		snprintf(buf, size, "ram:%04x", key & 0xFFFF);
+	else
+		snprintf(buf, size, "%02x:%04x", key >> 16, key & 0xFFFF);
+}
+
+static int compare_spots(const void *a, const void *b) {
+	const ProfileSpot *x = a, *y = b;
+
+	if (x->n.cycles != y->n.cycles)
+		return x->n.cycles < y->n.cycles ? 1 : -1;
+	return x->key < y->key ? -1 : x->key > y->key;
+}
+
+int profile_report(const char *fn) {
+	FILE *fp;
+	ProfileSpot *hot, all[512];
+	uint64_t count = 0, cycles = 0;
+	unsigned int hot_count = 0, i;
+	char name[16], text[32];
+	Byte code[3];
+
+	fp = fopen(fn, "w");
+	if (fp == NULL) {
+		perror(fn);
+		return -1;
+	}
+	if (!disasm_loaded())
+		debug_init();
+
+	hot = malloc((spot_count ? spot_count : 1) * sizeof(ProfileSpot));
+	for (i = 0; i < spot_capacity; i++) {
+		if (spots[i].n.count == 0)
+			continue;
+		hot[hot_count++] = spots[i];
+		count += spots[i].n.count;
+		cycles += spots[i].n.cycles;
+	}
+	if (cycles == 0)
+		cycles = 1;
+	qsort(hot, hot_count, sizeof(ProfileSpot), compare_spots);
+	fprintf(fp, "# %llu instructions, %llu cycles, at %u places\n",
+	        (unsigned long long)count, (unsigned long long)cycles, hot_count);
+	fprintf(fp, "# bank:pc      instructions         cycles       %%  instruction\n");
+	for (i = 0; i < hot_count && i < PROFILE_HOTSPOTS; i++) {
+		spot_name(hot[i].key, name, sizeof(name));
+		spot_code(hot[i].key, code);
+		disasm_string(code, text, sizeof(text));
+		fprintf(fp, "%-10s %15llu %14llu %6.2f  %s\n", name,
+		        (unsigned long long)hot[i].n.count,
+		        (unsigned long long)hot[i].n.cycles,
+		        hot[i].n.cycles * 100.0 / cycles, text);
+	}
+	free(hot);
+
+	/* the opcodes, the 0xCB page keyed above the rest */
+	for (i = 0; i < 256; i++) {
+		all[i].key = i;
+		all[i].n = ops[i];
+		all[256 + i].key = 0xCB00 | i;
+		all[256 + i].n = cb_ops[i];
+	}
+	qsort(all, 512, sizeof(ProfileSpot), compare_spots);
+	fprintf(fp, "\n# opcode   instructions         cycles       %%  instruction\n");
+	for (i = 0; i < 512 && all[i].n.count > 0; i++) {
+		code[0] = all[i].key > 0xFF ? 0xCB : all[i].key;
+		code[1] = all[i].key & 0xFF;
+		disasm_opcode(code, text, sizeof(text));
+		snprintf(name, sizeof(name), all[i].key > 0xFF ? "cb %02x" : "%02x",
+		         all[i].key & 0xFF);
+		fprintf(fp, "%-10s %15llu %14llu %6.2f  %s\n", name,
+		        (unsigned long long)all[i].n.count,
+		        (unsigned long long)all[i].n.cycles,
+		        all[i].n.cycles * 100.0 / cycles, text);
+	}
+	fclose(fp);
+	return 0;
+}
+
+/* the stacks under node n, whose own is in path */
+static void write_folded(FILE *fp, int n, char *path, unsigned int len) {
+	char name[20];
+	int c;
+
+	if (n != 0) {
+		spot_name(nodes[n].key, name, sizeof(name));
+		len += sprintf(path + len, ";%s%s", nodes[n].is_irq ? "irq_" : "", name);
+	}
+	if (nodes[n].cycles > 0)
+		fprintf(fp, "%s %llu\n", path, (unsigned long long)nodes[n].cycles);
+	for (c = nodes[n].child; c >= 0; c = nodes[c].sibling)
+		write_folded(fp, c, path, len);
+}
+
+int profile_folded(const char *fn) {
+	FILE *fp;
+	char *path;
+
+	fp = fopen(fn, "w");
+	if (fp == NULL) {
+		perror(fn);
+		return -1;
+	}
+	if (nodes != NULL) {
+		path = malloc(PROFILE_DEPTH * 20 + 8);
+		strcpy(path, "main");
+		write_folded(fp, 0, path, strlen(path));
+		free(path);
+	}
+	fclose(fp);
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * profile.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdint.h>
+#include "gbem.h"
+
+/* the instruction profiler. It counts the instructions run and the cycles
+ * they take at each rom bank and pc, and for each opcode, the 0xCB page
+ * apart. It also follows CALLs, RSTs, interrupts and RETs to charge the
+ * cycles to call stacks, for flame graphs. Only the debugging version of
+ * execute_cycles profiles, chosen by core_profile() (see core.c), so the
+ * profiler costs nothing when it is off. Like the debugger it belongs to
+ * the process, so should only profile one thread at once. */
+
+#define PROFILE_HOTSPOTS	200		/* lines in the report */
+#define PROFILE_DEPTH		256		/* deepest call stack followed */
+#define PROFILE_RAM			0xFFFF	/* the "bank" of code run from ram */
+
+/* forget everything counted so far */
+void profile_reset(void);
+/* called by execute.h, before and after each instruction */
+void profile_op(Word pc);
+void profile_done(unsigned int cycles);
+/* the hotspots and opcodes, most cycles first, disassembled with the
+ * table from debug.c */
+int profile_report(const char *fn);
+/* the call stacks, as "caller;callee cycles" lines for flamegraph.pl.
+ * Functions are named by their bank and address, interrupt handlers as
+ * irq_ and theirs */
+int profile_folded(const char *fn);
+
+#endif /* _PROFILE_H */
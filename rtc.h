@@ -2,8 +2,21 @@
 #define _RTC_H
 
 #include <stdio.h>
+#include <time.h>
 #include "gbem.h"
 
+typedef struct {
+	Byte regs[5];
+	Byte regs_latched[5];
+	int is_halted;
+	time_t start_time;		/* when the clock would have read zero */
+	time_t halt_time;		/* when it was halted, if it is */
+} Rtc;
+
+/* the clock in the selected instance's cart, see instance.h */
+extern __thread Rtc *gb_rtc;
+#define rtc		(*gb_rtc)
+
 void rtc_set_register(Byte r, Byte value);
 Byte rtc_get_register(Byte r);
 
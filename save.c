@@ -130,6 +130,7 @@ void load_state(void) {
 		line = NULL;
 	}
 	
+	display_flush();
 	core_load();
 	memory_load();
 	cart_load();
@@ -275,7 +276,6 @@ static int get_index(char* key) {
  * returns a pointer to a dynamically allocated string, which must be free()'d.
  */
 static char* get_fn(void) {
-	extern Cart cart;
 	char *fn;
 	unsigned int fn_len;
 	assert(save_slot < 100);
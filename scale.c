@@ -24,6 +24,10 @@
  * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include "config.h"
+
+#ifndef GBEM_NO_SDL
+
 #include <SDL/SDL.h>
 #include <assert.h>
 #include <stdint.h>
@@ -214,5 +218,4 @@ static inline void put_pixel(const SDL_Surface* restrict surface, const int x, c
 	*(Uint32 *)((Uint8 *)surface->pixels + (y * surface->pitch) + (x * 4)) = pixel;
 }
 
-
-
+#endif /* GBEM_NO_SDL */
@@ -0,0 +1,177 @@
+/*
+ * sched.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "sched.h"
+#include "core.h"
+#include "display.h"
+#include "timer.h"
+#include "sound.h"
+#include "serial2sock.h"
+#include "split.h"
+
+/* called with the cycle the event was due, which may be a few cycles
+ * before sched.now as instructions aren't split */
+static void (*const handlers[SCHED_EVENTS])(uint64_t due) = {
+	display_event,
+	timer_event,
+	serial_event,
+	sound_event
+};
+
+/* what each handler's time counts as, see split.h */
+static const Split splits[SCHED_EVENTS] = {
+	SPLIT_DISPLAY,
+	SPLIT_TIMER,
+	SPLIT_OTHER,
+	SPLIT_SOUND
+};
+
+static void swap(int i, int j) {
+	int e = sched.heap[i];
+	sched.heap[i] = sched.heap[j];
+	sched.heap[j] = e;
+	sched.pos[sched.heap[i]] = i;
+	sched.pos[sched.heap[j]] = j;
+}
+
+static void sift_up(int i) {
+	while (i > 0 && sched.when[sched.heap[i]] <
+			sched.when[sched.heap[(i - 1) / 2]]) {
+		swap(i, (i - 1) / 2);
+		i = (i - 1) / 2;
+	}
+}
+
+static void sift_down(int i) {
+	int child;
+
+	while ((child = 2 * i + 1) < SCHED_EVENTS) {
+		if (child + 1 < SCHED_EVENTS && sched.when[sched.heap[child + 1]] <
+				sched.when[sched.heap[child]])
+			++child;
+		if (sched.when[sched.heap[i]] <= sched.when[sched.heap[child]])
+			break;
+		swap(i, child);
+		i = child;
+	}
+}
+
+/* clear the schedule and the cycle count. Must be called before the other
+ * modules are reset, as they put their events on it */
+void sched_reset(void) {
+	int i;
+
+	sched.now = 0;
+	sched.cpu_start = core.cycles;
+	for (i = 0; i < SCHED_EVENTS; i++) {
+		sched.when[i] = SCHED_NEVER;
+		sched.heap[i] = i;
+		sched.pos[i] = i;
+	}
+}
+
+/* (re)schedule an event for the given cycle. If that is already past, it
+ * happens as soon as the current instruction finishes */
+void sched_at(SchedEvent e, uint64_t when) {
+	uint64_t old = sched.when[e];
+
+	sched.when[e] = when;
+	if (when < old)
+		sift_up(sched.pos[e]);
+	else
+		sift_down(sched.pos[e]);
+}
+
+/* the first cycle at which an event could raise an interrupt enabled in IE,
+ * which is the only thing that ends a halt. The display also stops it at
+ * vblank, so the frame isn't slept through */
+static uint64_t next_interrupt(void) {
+	Byte ie = read_io(HWREG_IE);
+	uint64_t when = display_next_interrupt(ie);
+
+	if ((ie & INT_TIMER) && sched.when[SCHED_TIMER] < when)
+		when = sched.when[SCHED_TIMER];
+	if ((ie & INT_SERIAL) && sched.when[SCHED_SERIAL] < when)
+		when = sched.when[SCHED_SERIAL];
+	return when;
+}
+
+/* run the machine for at least the given number of cycles, handling each
+ * event as it comes due. Returns the number of cycles actually run.
+ *
+ * A halted cpu skips straight to the next event that could wake it (or the
+ * end of the run), and the events on the way are handled late, all at
+ * once: the display catches up line by line, the timer counts the ticks
+ * and the sound renders them. Button presses come from outside, so they
+ * are noticed at the end of the run at the latest.
+ *
+ * The run ends early if an event calls sched_stop(). */
+unsigned int sched_run(unsigned int cycles) {
+	uint64_t start = sched.now;
+	uint64_t end = start + cycles;
+	uint64_t next;
+	int e;
+
+	sched.is_stopped = 0;
+	while (sched.now < end && !sched.is_stopped) {
+		next = sched.when[sched.heap[0]];
+		if (core.is_halted && !core.int_pending)
+			next = next_interrupt();
+		if (next > end)
+			next = end;
+		if (next > sched.now) {
+			SPLIT_ENTER(SPLIT_CORE);
+			sched.cpu_start = core.cycles;
+			sched.now += execute_cycles(next - sched.now);
+			sched.cpu_start = core.cycles;
+			SPLIT_LEAVE();
+		}
+		SPLIT_ENTER(SPLIT_TIMER);
+		timer_sync();
+		SPLIT_LEAVE();
+		while (sched.when[sched.heap[0]] <= sched.now) {
+			e = sched.heap[0];
+			next = sched.when[e];
+			sched_cancel(e);
+			SPLIT_ENTER(splits[e]);
+			handlers[e](next);
+			SPLIT_LEAVE();
+		}
+	}
+	return sched.now - start;
+}
+
+/* the current cycle. sched.now only moves on once execute_cycles returns,
+ * so while the cpu is running, e.g. in a memory handler, this also counts
+ * what it has run so far */
+uint64_t sched_time(void) {
+	return sched.now + (core.cycles - sched.cpu_start);
+}
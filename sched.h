@@ -0,0 +1,89 @@
+/*
+ * sched.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GBEM_SCHED_H
+#define _GBEM_SCHED_H
+
+#include "gbem.h"
+
+/* things that happen at a cycle known in advance. Rather than polling the
+ * timer, display and sound after every few instructions, sched_run() runs
+ * the cpu straight up to the earliest of these and then calls its
+ * handler. Events are one shot: an event is taken off the schedule before
+ * its handler is called, and the handler puts it back on if it repeats. */
+
+typedef enum {
+	SCHED_DISPLAY,		/* next lcd mode change (and hdma block) */
+	SCHED_TIMER,		/* TIMA overflow, while TAC enables it */
+	SCHED_SERIAL,		/* end of a serial transfer */
+	SCHED_SOUND,		/* render the sound channels so far */
+	SCHED_EVENTS
+} SchedEvent;
+
+#define SCHED_NEVER		UINT64_MAX
+
+typedef struct {
+	uint64_t now;					/* cycles run since reset */
+	uint64_t cpu_start;				/* core.cycles when now was last moved on */
+	uint64_t when[SCHED_EVENTS];	/* when each event is due, or SCHED_NEVER */
+	int heap[SCHED_EVENTS];			/* min heap of events, ordered by when */
+	int pos[SCHED_EVENTS];			/* where each event is in heap */
+	int is_stopped;					/* sched_stop() was called during this run */
+} Scheduler;
+
+/* the schedule of the selected instance, see instance.h */
+extern __thread Scheduler *gb_sched;
+#define sched	(*gb_sched)
+
+void sched_reset(void);
+void sched_at(SchedEvent e, uint64_t when);
+unsigned int sched_run(unsigned int cycles);
+uint64_t sched_time(void);
+
+static inline void sched_after(SchedEvent e, unsigned int cycles) {
+	sched_at(e, sched.now + cycles);
+}
+
+static inline void sched_cancel(SchedEvent e) {
+	sched_at(e, SCHED_NEVER);
+}
+
+/* end the current sched_run() once the events now due are handled, e.g.
+ * at the end of a frame */
+static inline void sched_stop(void) {
+	sched.is_stopped = 1;
+}
+
+static inline int sched_pending(SchedEvent e) {
+	return sched.when[e] != SCHED_NEVER;
+}
+
+#endif	//_GBEM_SCHED_H
@@ -13,18 +13,24 @@
 #include <errno.h>
 
 #include <stdio.h>
-#include <SDL/SDL_timer.h>
-#include <SDL/SDL_thread.h>
+#include <strings.h>
+#include <pthread.h>
 
 #include "serial2sock.h"
 
 #include "memory.h"
 #include "core.h"
+#include "sched.h"
+#include "instance.h"
 
-static int sockfd = -1;
-static SDL_Thread *tLink = NULL;
+/* 8 bits at 8192Hz, or 32 times that in gbc fast mode */
+#define TRANSFER_CYCLES		4096
 
-static int linkThread(void *arg);
+#define sockfd		(gb_serial->sockfd)
+#define tLink		(gb_serial->link)
+#define has_link	(gb_serial->has_link)
+
+static void *linkThread(void *arg);
 
 void serial_listen(int port) {
 	if (sockfd < 1) {
@@ -63,10 +69,10 @@ void serial_listen(int port) {
 		}
 		close(listenfd);
 
-		if (tLink != NULL) {
+		if (has_link) {
 			; //TODO make tLink quit
 		}
-		tLink = SDL_CreateThread(linkThread, (void *) NULL);
+		has_link = (pthread_create(&tLink, NULL, linkThread, (void *) gb) == 0);
 	}
 }
 
@@ -89,19 +95,20 @@ void serial_connect(char* hostname, int port) {
 			return;
 		}
 
-		if (tLink != NULL) {
+		if (has_link) {
 			; //TODO make tLink quit
 		}
-		tLink = SDL_CreateThread(linkThread, (void *) NULL);
+		has_link = (pthread_create(&tLink, NULL, linkThread, (void *) gb) == 0);
 	}
 }
 
-static int linkThread(void *arg) {
+static void *linkThread(void *arg) {
+	gb_select(arg);
 	while (1) {
 		Byte sbRemote;
 		if (sockfd < 0) {
 			printf("Invalid Socket!\n");
-			return -1;
+			return NULL;
 		}
 		int n = read(sockfd, &sbRemote, sizeof(sbRemote));
 		if (n == 0) {
@@ -109,7 +116,7 @@ static int linkThread(void *arg) {
 			printf("Disconnecte!\n");
 			close(sockfd);
 			sockfd = -1;
-			return 0;
+			return NULL;
 		} else if (n > 0) {
 			Byte sc = readb(HWREG_SC);
 			if ((sc & 0x80)) {
@@ -138,18 +145,19 @@ static int linkThread(void *arg) {
 		}
 		usleep(200);
 	}
-	return 0;
+	return NULL;
 }
 
 void serial_tx(Byte sb, Byte sc) {
 	if ((sc & 0x80) && (sc & 0x01)) {
 		//TX Data:
 		if (sockfd < 0) {
-			//No GameBoy Connected
+			//No GameBoy Connected: shift in 0xff once the byte is out
 			printf("Not Connected!\n");
-			write_io(HWREG_SB, 0xff);
-			write_io(HWREG_SC, sc & (~0x80));
-			raise_int(INT_SERIAL);
+			if ((sc & SER_CLOCK_SPEED) && console_mode == MODE_GBC_ENABLED)
+				sched_after(SCHED_SERIAL, TRANSFER_CYCLES / 32);
+			else
+				sched_after(SCHED_SERIAL, TRANSFER_CYCLES);
 		} else {
 			printf("SC: %02x\n", sc);
 			printf("[send] : %02x\n", sb);
@@ -158,3 +166,11 @@ void serial_tx(Byte sb, Byte sc) {
 		}
 	}
 }
+
+/* scheduler callback: end of a transfer with nothing on the other end */
+void serial_event(uint64_t due) {
+	(void)due;
+	write_io(HWREG_SB, 0xff);
+	write_io(HWREG_SC, read_io(HWREG_SC) & (~0x80));
+	raise_int(INT_SERIAL);
+}
@@ -7,6 +7,7 @@
 
 #ifndef SERIAL2SOCK_H_
 #define SERIAL2SOCK_H_
+#include <pthread.h>
 #include "gbem.h"
 
 /* Serial Controll Register(HWREG_SC):
@@ -19,6 +20,16 @@
 #define SER_CLOCK_SPEED 0x02
 #define SER_CLOCK_SELECT 0x01
 
+typedef struct {
+	int sockfd;				/* -1 if there's no link cable */
+	pthread_t link;			/* reads from the other end */
+	int has_link;
+} Serial;
+
+/* the link port of the selected instance, see instance.h */
+extern __thread Serial *gb_serial;
+
 void serial_tx(Byte sb, Byte sc);
+void serial_event(uint64_t due);
 
 #endif /* SERIAL2SOCK_H_ */
@@ -28,13 +28,18 @@
 #include <stdlib.h>
 #include <math.h>
 #include <assert.h>
+#include <pthread.h>
 #include <string.h>
-#include <SDL/SDL.h>
 #include "gbem.h"
 #include "sound.h"
 #include "memory.h"
+#include "core.h"
+#include "instance.h"
 #include "save.h"
 #include "blip_buf.h"
+#include "sched.h"
+#include "backend.h"
+#include "split.h"
 
 #define MAX_SAMPLE			32767
 #define MIN_SAMPLE			-32767
@@ -45,13 +50,16 @@
 #define LFSR_15_SIZE		32768
 #define LFSR_15				0
 #define LFSR_7				1
+/* how often the channels are rendered when no sound register is written.
+ * Only affects how up to date the channel bits in NR52 are */
+#define UPDATE_CYCLES		1024
 
 enum Side { LEFT, RIGHT };
 enum Counter { PERIOD, LENGTH, ENVELOPE, SWEEP };
 
 static inline void mark_channel_on(unsigned int channel);
 static inline void mark_channel_off(unsigned int channel);
-static void callback(void* data, Uint8 *stream, int len);
+static void sound_keep(void);
 static inline void update_channel1(int clocks);
 static inline void update_channel2(int clocks);
 static inline void update_channel3(int clocks);
@@ -77,27 +85,27 @@ static const unsigned char gbc_wave[] = {
 	0x00, 0xff, 0x00, 0xff, 0x00, 0xff, 0x00, 0xff
 };
 
+#define sound			(*gb_sound)
+#define blip_left		(gb_sound->blip_left)
+#define blip_right		(gb_sound->blip_right)
+#define wave_samples	(gb_sound->wave_samples)
+
+/* the audio device and the lfsr tables are shared by all instances */
 int sound_enabled;
-int sound_cycles;
 
 static short *lfsr[2];
 static unsigned lfsr_size[2];
-static short* wave_samples;
 static int sample_rate = 44100;
-static blip_t* blip_left;
-static blip_t* blip_right;
-static SoundData sound;
-static SDL_mutex *sound_mutex;
-
-extern int console;
-extern int console_mode;
+static int is_device_open;
+static pthread_once_t lfsr_once = PTHREAD_ONCE_INIT;
 
-void sound_init(void) {
+/* the lfsr tables are built once, by whichever instance starts first, and
+ * kept until the process exits */
+static void lfsr_init(void) {
 	unsigned char r7;
 	unsigned short r15;
 	unsigned int i;
-	SDL_AudioSpec desired;
-	
+
 	lfsr_size[LFSR_7] = LFSR_7_SIZE;
 	lfsr_size[LFSR_15] = LFSR_15_SIZE;
 
@@ -125,53 +133,53 @@ void sound_init(void) {
 		else
 			lfsr[LFSR_15][i] = LOW / 15;
 	}
-	
-	wave_samples = malloc(32 * sizeof(short));
-
-	SDL_InitSubSystem(SDL_INIT_AUDIO);
+}
 
-	desired.freq = sample_rate;
-	desired.format = AUDIO_S16SYS;
-	desired.channels = 2;
-	desired.samples = 2048;
-	desired.callback = callback;
-	desired.userdata = NULL;
-	
-	if (SDL_OpenAudio(&desired, NULL) < 0) {
-		fprintf(stderr, "couldn't initialise SDL audio: %s\n", SDL_GetError());
-		exit(1);
-   	}
-	fprintf(stdout, "sdl audio initialised.\n");
-	
+void sound_init(void) {
 	blip_left = blip_new(sample_rate / 10);
 	blip_set_rates(blip_left, 4194304, sample_rate);
 
 	blip_right = blip_new(sample_rate / 10);
 	blip_set_rates(blip_right, 4194304, sample_rate);
 
-    sound_mutex = SDL_CreateMutex();
-	sound_enabled = 0;
-	start_sound();
+	sound_discard();
+
+	/* the first instance is the one that gets heard, if the backend has
+	 * anything to play it on */
+	if (backend->audio_open != NULL && !is_device_open) {
+		backend->audio_open(sample_rate, gb);
+		is_device_open = 1;
+		sound.is_heard = 1;
+		sound_enabled = 0;
+		start_sound();
+	}
+
+	pthread_once(&lfsr_once, lfsr_init);
 }
 
 void sound_fini(void) {
-	if (sound_enabled == 1) {
-		stop_sound();
+	if (sound.is_heard) {
+		if (sound_enabled == 1)
+			stop_sound();
+		backend->audio_close();
+		is_device_open = 0;
+		sound.is_heard = 0;
 	}
-	SDL_CloseAudio();
-	free(lfsr[LFSR_7]);
-	free(lfsr[LFSR_15]);
+	blip_delete(blip_left);
+	blip_delete(blip_right);
 }
 
 void stop_sound(void) {
 	assert(sound_enabled == 1);
-	SDL_PauseAudio(1);
+	if (is_device_open)
+		backend->audio_pause(1);
 	sound_enabled = 0;
 }
 
 void start_sound(void) {
 	assert(sound_enabled == 0);
-	SDL_PauseAudio(0);
+	if (is_device_open)
+		backend->audio_pause(0);
 	sound_enabled = 1;
 }
 
@@ -229,6 +237,7 @@ void sound_reset(void) {
 	sound.channel4.length.i = 16384;
 	sound.channel4.envelope.i = 65536;
 
+	sched_after(SCHED_SOUND, UPDATE_CYCLES);
 
 	if ((console == CONSOLE_GBC) || (console == CONSOLE_GBA)) {
 		for (int i = 0; i < 16; i++)
@@ -481,12 +490,19 @@ static inline void mark_channel_off(unsigned int channel) {
 	write_io(HWREG_NR52, read_io(HWREG_NR52) & ~(0x01 << (channel - 1)));
 }
 
+/* scheduler callback */
+void sound_event(uint64_t due) {
+	sound_update();
+	sched_at(SCHED_SOUND, due + UPDATE_CYCLES);
+}
+
 void sound_update() {
 	if (sound_cycles == 0)
 		return;
 
-	//SDL_LockAudio();
-	SDL_LockMutex(sound_mutex);
+	SPLIT_ENTER(SPLIT_SOUND);
+	if (sound.is_heard)
+		backend->audio_lock();
 	update_channel1(sound_cycles);
 	update_channel2(sound_cycles);
 	update_channel3(sound_cycles);
@@ -494,10 +510,13 @@ void sound_update() {
 
 	blip_end_frame(blip_left, sound_cycles);
 	blip_end_frame(blip_right, sound_cycles);
-	SDL_UnlockMutex(sound_mutex);
+	if (sound.is_heard)
+		backend->audio_unlock();
+	else
+		sound_keep();
 
 	sound_cycles = 0;
-	//SDL_UnlockAudio();
+	SPLIT_LEAVE();
 }
 
 static void update_channel1(int clocks) {
@@ -822,12 +841,66 @@ void sound_load(void) {
 	
 }
 
-static void callback(void* data, Uint8 *stream, int len) {
-	Sint16 *buffer = (Sint16 *)stream;
+/* called by the backend from its audio thread, with the audio locked, to
+ * take count stereo samples of the instance it plays */
+void sound_fill(void *instance, short *buffer, int count) {
+	gb_select(instance);
 	sound_update();
-	
-	SDL_LockMutex(sound_mutex);
-	blip_read_samples(blip_left, buffer, len / 4, 1);
-	blip_read_samples(blip_right, buffer + 1, len / 4, 1);
-	SDL_UnlockMutex(sound_mutex);
+	blip_read_samples(blip_left, buffer, count, 1);
+	blip_read_samples(blip_right, buffer + 1, count, 1);
+}
+
+/* an instance nobody listens to keeps its latest samples in
+ * sound.samples, dropping the oldest when it fills up */
+static void sound_keep(void) {
+	int avail = blip_samples_avail(blip_left);
+
+	while (avail > 0) {
+		int end = (sound.samples_start + sound.samples_count) % SOUND_BUFFER_SAMPLES;
+		int count = SOUND_BUFFER_SAMPLES - end;
+		if (count > avail)
+			count = avail;
+		blip_read_samples(blip_left, &sound.samples[end * 2], count, 1);
+		blip_read_samples(blip_right, &sound.samples[end * 2 + 1], count, 1);
+		sound.samples_count += count;
+		if (sound.samples_count > SOUND_BUFFER_SAMPLES) {
+			sound.samples_start = (sound.samples_start + sound.samples_count - SOUND_BUFFER_SAMPLES) % SOUND_BUFFER_SAMPLES;
+			sound.samples_count = SOUND_BUFFER_SAMPLES;
+		}
+		avail -= count;
+	}
+}
+
+/* takes up to count of the stereo samples kept by sound_keep(), oldest
+ * first. Returns how many were taken */
+int sound_samples(short *buffer, int count) {
+	int taken = 0;
+
+	while (taken < count && sound.samples_count > 0) {
+		int n = SOUND_BUFFER_SAMPLES - sound.samples_start;
+		if (n > sound.samples_count)
+			n = sound.samples_count;
+		if (n > count - taken)
+			n = count - taken;
+		memcpy(&buffer[taken * 2], &sound.samples[sound.samples_start * 2], n * 2 * sizeof(short));
+		sound.samples_start = (sound.samples_start + n) % SOUND_BUFFER_SAMPLES;
+		sound.samples_count -= n;
+		taken += n;
+	}
+	return taken;
+}
+
+/* the stereo samples kept by sound_keep(), left where they are: returns
+ * the oldest, with count set to how many follow it in one piece */
+const short *sound_peek(int *count) {
+	*count = SOUND_BUFFER_SAMPLES - sound.samples_start;
+	if (*count > sound.samples_count)
+		*count = sound.samples_count;
+	return &sound.samples[sound.samples_start * 2];
+}
+
+/* forget the kept samples, so the next ones start at the front */
+void sound_discard(void) {
+	sound.samples_start = 0;
+	sound.samples_count = 0;
 }
@@ -30,8 +30,14 @@
 //#include <stdbool.h>
 
 #include "gbem.h"
+#include "blip_buf.h"
+
+/* stereo samples kept for an instance that isn't being played, about a
+ * tenth of a second */
+#define SOUND_BUFFER_SAMPLES	4096
 
 void sound_update();
+void sound_event(uint64_t due);
 
 typedef struct {
 	unsigned duty;
@@ -123,9 +129,26 @@ typedef struct {
 	SquareChannel channel2;
 	SampleChannel channel3;
 	NoiseChannel channel4;
+	/* the channels' output so far, read by the audio callback */
+	blip_t *blip_left;
+	blip_t *blip_right;
+	short wave_samples[32];
+	int cycles;				/* run since the channels were last brought up to date */
+	int is_heard;			/* played by the backend, see sound_init() */
+	/* what the channels played, if nobody is listening, see sound_samples() */
+	short samples[SOUND_BUFFER_SAMPLES * 2];
+	int samples_start, samples_count;
 } SoundData;
 
+/* the sound of the selected instance, see instance.h */
+extern __thread SoundData *gb_sound;
+#define sound_cycles	(gb_sound->cycles)
+
 void sound_init(void);
+void sound_fill(void *instance, short *buffer, int count);
+int sound_samples(short *buffer, int count);
+const short *sound_peek(int *count);
+void sound_discard(void);
 void sound_fini(void);
 void write_sound(Word address, Byte value);
 void write_wave(Word address, Byte value);
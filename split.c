@@ -0,0 +1,88 @@
+/*
+ * split.c
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include <time.h>
+
+#include "split.h"
+
+#define SPLIT_DEPTH		8
+
+__thread int splitting;
+
+static __thread uint64_t split_time[SPLITS];
+static __thread Split stack[SPLIT_DEPTH];
+static __thread int depth;
+static __thread uint64_t last;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* charge the time since the last change to the part on top */
+static void charge(void) {
+	uint64_t t = now_ns();
+
+	split_time[stack[depth]] += t - last;
+	last = t;
+}
+
+void split_start(void) {
+	memset(split_time, 0, sizeof(split_time));
+	depth = 0;
+	stack[0] = SPLIT_OTHER;
+	last = now_ns();
+	splitting = 1;
+}
+
+void split_stop(void) {
+	charge();
+	splitting = 0;
+}
+
+void split_enter(Split s) {
+	charge();
+	if (depth < SPLIT_DEPTH - 1)
+		++depth;
+	stack[depth] = s;
+}
+
+void split_leave(void) {
+	charge();
+	if (depth > 0)
+		--depth;
+}
+
+uint64_t split_ns(Split s) {
+	return split_time[s];
+}
@@ -0,0 +1,65 @@
+/*
+ * split.h
+ * Copyright (C) abhoriel 2010 <abhoriel@gmail.com>
+ * 
+ * gbem is free software copyrighted by abhoriel.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name ``abhoriel'' nor the name of any other
+ *    contributor may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ * 
+ * gbem IS PROVIDED BY abhoriel ``AS IS'' AND ANY EXPRESS
+ * OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL abhoriel OR ANY OTHER CONTRIBUTORS
+ * BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR
+ * BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _SPLIT_H
+#define _SPLIT_H
+
+#include <stdint.h>
+
+/* where the host's time goes, by part of the machine. Off unless
+ * split_start() is called, and then the time between each pair of
+ * SPLIT_ENTER and SPLIT_LEAVE is charged to that part, less any time
+ * spent in parts entered inside it. Time outside all of them, in the
+ * scheduler or the front end, is SPLIT_OTHER. Per thread, like the
+ * instances (see instance.h). */
+
+typedef enum {
+	SPLIT_OTHER,
+	SPLIT_CORE,			/* execute_cycles */
+	SPLIT_DISPLAY,		/* display_update */
+	SPLIT_SOUND,		/* sound_update */
+	SPLIT_TIMER,		/* timer_sync */
+	SPLITS
+} Split;
+
+extern __thread int splitting;
+
+void split_start(void);
+void split_stop(void);
+void split_enter(Split s);
+void split_leave(void);
+/* nanoseconds charged to s between split_start() and split_stop() */
+uint64_t split_ns(Split s);
+
+#define SPLIT_ENTER(s)	do { if (splitting) split_enter(s); } while (0)
+#define SPLIT_LEAVE()	do { if (splitting) split_leave(); } while (0)
+
+#endif	//_SPLIT_H
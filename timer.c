@@ -29,45 +29,98 @@
 #include "memory.h"
 #include "core.h"
 
-static unsigned int tima_time;
-static unsigned int div_time;
+/* DIV and TIMA are brought up to date when the cpu stops for an event and
+ * when it reads or writes a timer register (see read_high() in memory.c):
+ * giving every tick an event of its own would stop the cpu every 16 to 64
+ * cycles. The only event here is TIMA overflowing, as that raises an
+ * interrupt. */
+
+#define timer_time		(gb_timer->time)
+#define div_time		(gb_timer->div_time)
+#define tima_time		(gb_timer->tima_time)
 
 // periods for each tima setting, in machine cycles
 static const unsigned int tima_periods[] = {1024, 16, 64, 256};
 
 static inline unsigned int get_tima_period(void);
 static inline unsigned int get_div_period(void);
+static void timer_schedule(void);
 
 void timer_reset(void) {
-	tima_time = 0;
+	timer_time = sched_time();
 	div_time = 0;
+	tima_time = 0;
+	timer_schedule();
 }
 
-void timer_check(unsigned int period) {
+/* count the ticks since the last sync into DIV and TIMA */
+void timer_sync(void) {
+	uint64_t now = sched_time();
+	unsigned int period, ticks, tima;
+
+	if (now <= timer_time)
+		return;
+	period = (now - timer_time) * core.frequency;
+	timer_time = now;
+
+	div_time += period;
+	if (div_time >= get_div_period()) {
+		write_io(HWREG_DIV, read_io(HWREG_DIV) + div_time / get_div_period());
+		div_time %= get_div_period();
+	}
+
 	// check if tima timer is enabled
-	if (read_io(HWREG_TAC) & 0x04) {
-		tima_time += period;
-		while (tima_time >= get_tima_period()) {
-			// increment tima
-			write_io(HWREG_TIMA, read_io(HWREG_TIMA) + 1);
-			// has tima overflowed?
-			if (read_io(HWREG_TIMA) == 0) {
-				// reset tima 
-				write_io(HWREG_TIMA, read_io(HWREG_TMA));
-				// generate timer interrupt
-				write_io(HWREG_IF, read_io(HWREG_IF) | INT_TIMER);
-			}
-			tima_time -= get_tima_period();
-		}
-	} else {
+	if (!(read_io(HWREG_TAC) & 0x04)) {
 		tima_time = 0;
+		return;
+	}
+	tima_time += period;
+	ticks = tima_time / get_tima_period();
+	tima_time %= get_tima_period();
+	tima = read_io(HWREG_TIMA);
+	// has tima overflowed?
+	while (ticks >= 0x100 - tima) {
+		ticks -= 0x100 - tima;
+		// reset tima 
+		tima = read_io(HWREG_TMA);
+		// generate timer interrupt
+		raise_int(INT_TIMER);
 	}
+	write_io(HWREG_TIMA, tima + ticks);
+}
+
+/* a write to DIV, TIMA, TMA or TAC. Ticks up to now count with the old
+ * values */
+void timer_write(Word address, Byte value) {
+	timer_sync();
+	// If DIV is written to, it is set to 0.
+	if (address == HWREG_DIV)
+		value = 0;
+	write_io(address, value);
+	timer_schedule();
+}
 
-	div_time += period;	
-	while (div_time >= get_div_period()) {
-		write_io(HWREG_DIV, read_io(HWREG_DIV) + 1);
-		div_time -= get_div_period();
+void timer_event(uint64_t due) {
+	/* sched_run has already synced, which dealt with the overflow, and
+	 * tima_time is counted from sched.now, not from due */
+	(void)due;
+	timer_schedule();
+}
+
+/* put the next TIMA overflow on the schedule */
+static void timer_schedule(void) {
+	int left;
+
+	if (!(read_io(HWREG_TAC) & 0x04)) {
+		sched_cancel(SCHED_TIMER);
+		return;
 	}
+	/* after a speed change, tima_time can be over a whole period */
+	left = (0x100 - read_io(HWREG_TIMA)) * get_tima_period() - tima_time;
+	if (left < 0)
+		left = 0;
+	sched_at(SCHED_TIMER,
+			sched_time() + (left + core.frequency - 1) / core.frequency);
 }
 
 // This function returns the time between TIMA incrementation.
@@ -79,4 +132,3 @@ static inline unsigned int get_tima_period(void) {
 static inline unsigned int get_div_period(void) {
 	return 64;
 }
-
@@ -27,7 +27,22 @@
 #ifndef _TIMER_H
 #define _TIMER_H
 
+#include "sched.h"
+
+/* DIV and TIMA are brought up to date when the cpu stops for an event or
+ * reads or writes a timer register, see timer.c */
+typedef struct {
+	uint64_t time;				/* sched_time() when they were last brought up to date */
+	unsigned int div_time;		/* timer cycles counted towards the next ticks */
+	unsigned int tima_time;
+} Timer;
+
+/* the timer of the selected instance, see instance.h */
+extern __thread Timer *gb_timer;
+
 void timer_reset(void);
-void timer_check(unsigned int period);
+void timer_sync(void);
+void timer_write(Word address, Byte value);
+void timer_event(uint64_t due);
 
 #endif	//_TIMER_H